@@ -1,6 +1,8 @@
 #pragma once
 
+#include "animation_clip.hpp"
 #include "basic_model.hpp"
+#include "render_stats.hpp"
 #include "shader.hpp"
 
 #include "ozz/animation/runtime/animation.h"
@@ -13,12 +15,13 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 
-using RuntimeSkeleton = ozz::unique_ptr<ozz::animation::Skeleton>;
-using RuntimeAnimation = ozz::unique_ptr<ozz::animation::Animation>;
+using RuntimeSkeleton = std::shared_ptr<ozz::animation::Skeleton>; // Shared by the models instanced from one import
 
 struct Joint
 {
@@ -28,6 +31,13 @@ struct Joint
     glm::mat4 invBindPose;
 };
 
+// How PlayAnimation moves from one clip to the next
+enum class TransitionMode
+{
+    CROSSFADE,       // Samples both clips and blends them for the whole transition
+    INERTIALIZATION  // Samples the new clip only, the pose gap at the switch decays on top of it
+};
+
 static inline glm::mat4 OzzToGlmMat4(const ozz::math::Float4x4& from)
 {
     glm::mat4 to;
@@ -44,10 +54,10 @@ public:
     void Draw(const Shader& shader) const override
     {
         for (const auto& mesh : meshes)
-            mesh.Draw(shader);
+            mesh.Draw(shader, lod);
     }
 
-    void SetJoints(std::vector<Joint>& j) { joints = j; }
+    void SetJoints(const std::vector<Joint>& j) { joints = j; }
 
     void SetSkeleton(RuntimeSkeleton skel)
     {
@@ -55,21 +65,57 @@ public:
         numJoints = skeleton->num_joints();
         int numSoa = skeleton->num_soa_joints();
 
-        jointMatrices.resize(numJoints);
         currentLocal.resize(numSoa);
         previousLocal.resize(numSoa);
         blendedLocal.resize(numSoa);
+        inertialOffset.resize(numSoa);
         modelSpaceTransforms.resize(numJoints);
+        poseLocal.resize(numSoa);
+        poseModelSpace.resize(numJoints);
 
-        // Both contexts must be resized to num_joints
+        // All contexts must be resized to num_joints
         context.Resize(numJoints);
         previousContext.Resize(numJoints);
+        poseContext.Resize(numJoints);
+
+        // Until the loader says otherwise every joint is uploaded
+        std::vector<int> allJoints(numJoints);
+        for (int i = 0; i < (int)numJoints; ++i)
+            allJoints[i] = i;
+        SetPalette(allJoints);
+    }
+
+    // Maps palette slots (the BoneIDs stored in the vertices) to skeleton joints.
+    // Only joints that carry skin weights need a slot, the rest are never uploaded.
+    void SetPalette(const std::vector<int>& paletteJoints)
+    {
+        palette = paletteJoints;
+        jointMatrices.resize(palette.size());
+        paletteRows.resize(palette.size() * 3);
+        buildLeafMask();
+    }
+
+    // LOD joint mask: leaf joints (fingers, face...) stop being evaluated and follow their parent rigidly
+    void SetLeafJointsDropped(bool dropped) { leafJointsDropped = dropped; }
+
+    void SetTransitionMode(TransitionMode mode) { transitionMode = mode; }
+
+    void AddAnimation(AnimationClip clip)
+    {
+        animationsMap[clip.GetName()] = (unsigned int)animations.size();
+        animations.emplace_back(std::move(clip));
+        clipLastUsed.push_back(0.0f);
     }
 
-    void AddAnimation(RuntimeAnimation animation)
+    // Drops the runtime form of the clips that have not been played for idleTime seconds, when it can be rebuilt
+    void EvictAnimations(float idleTime)
     {
-        animationsMap[std::string(animation->name())] = (unsigned int)animations.size();
-        animations.emplace_back(std::move(animation));
+        for (unsigned int i = 0; i < animations.size(); ++i)
+        {
+            bool playing = i == currentAnimation || (isBlending && i == previousAnimation);
+            if (!playing && animations[i].IsBuilt() && animations[i].CanRelease() && playbackClock - clipLastUsed[i] > idleTime)
+                animations[i].Release();
+        }
     }
 
     void SampleAnimation(float deltaTime)
@@ -77,29 +123,20 @@ public:
         if (!skeleton || animations.empty()) return;
 
         // 1. Advance timelines
-        animationTime += deltaTime;
-        if (animationTime > animations[currentAnimation]->duration())
-            animationTime = fmod(animationTime, animations[currentAnimation]->duration());
-
-        if (isBlending)
-        {
-            previousAnimationTime += deltaTime;
-            if (previousAnimationTime > animations[previousAnimation]->duration())
-                previousAnimationTime = fmod(previousAnimationTime, animations[previousAnimation]->duration());
+        AdvanceAnimation(deltaTime);
+        EvaluatePose();
+    }
 
-            blendWeight += deltaTime / blendDuration;
-            if (blendWeight >= 1.0f)
-            {
-                blendWeight = 1.0f;
-                isBlending = false;
-            }
-        }
+    // Computes the joint matrices for the current point of the timelines
+    void EvaluatePose()
+    {
+        if (!skeleton || animations.empty()) return;
 
         // 2. Sample Current
         ozz::animation::SamplingJob samplingCurrent;
-        samplingCurrent.animation = animations[currentAnimation].get();
+        samplingCurrent.animation = useClip(currentAnimation);
         samplingCurrent.context = &context;
-        samplingCurrent.ratio = animationTime / animations[currentAnimation]->duration();
+        samplingCurrent.ratio = animationTime / animations[currentAnimation].GetDuration();
         samplingCurrent.output = ozz::make_span(currentLocal);
         if (!samplingCurrent.Run()) return;
 
@@ -107,9 +144,9 @@ public:
         {
             // 3. Sample Previous
             ozz::animation::SamplingJob samplingPrevious;
-            samplingPrevious.animation = animations[previousAnimation].get();
+            samplingPrevious.animation = useClip(previousAnimation);
             samplingPrevious.context = &previousContext;
-            samplingPrevious.ratio = previousAnimationTime / animations[previousAnimation]->duration();
+            samplingPrevious.ratio = previousAnimationTime / animations[previousAnimation].GetDuration();
             samplingPrevious.output = ozz::make_span(previousLocal);
             if (!samplingPrevious.Run()) return;
 
@@ -137,6 +174,10 @@ public:
                 std::copy(currentLocal.begin(), currentLocal.end(), blendedLocal.begin());
             }
         }
+        else if (isInertializing)
+        {
+            applyInertialOffset();
+        }
         else
         {
             std::copy(currentLocal.begin(), currentLocal.end(), blendedLocal.begin());
@@ -149,11 +190,25 @@ public:
         ltmJob.output = ozz::make_span(modelSpaceTransforms);
         ltmJob.Run();
 
-        // 6. Finalize for GPU
-        for (int i = 0; i < (int)numJoints; ++i)
+        // 6. Finalize for GPU, masked leaves copy their parent once it is done
+        unsigned int evaluated = 0;
+        for (size_t i = 0; i < palette.size(); ++i)
         {
-            jointMatrices[i] = OzzToGlmMat4(modelSpaceTransforms[i]) * joints[i].invBindPose;
+            if (leafJointsDropped && leafParentSlots[i] >= 0)
+                continue;
+            int joint = palette[i];
+            jointMatrices[i] = OzzToGlmMat4(modelSpaceTransforms[joint]) * joints[joint].invBindPose;
+            ++evaluated;
         }
+        if (leafJointsDropped)
+        {
+            for (size_t i = 0; i < palette.size(); ++i)
+                if (leafParentSlots[i] >= 0)
+                    jointMatrices[i] = jointMatrices[leafParentSlots[i]];
+        }
+        ++poseVersion;
+
+        RenderStats::GetInstance().EvaluatedJoints += evaluated;
     }
 
     void UpdateAnimation(float deltaTime)
@@ -162,6 +217,63 @@ public:
         SampleAnimation(deltaTime);
     }
 
+    // Advances the timelines (and crossfade) without sampling a pose, e.g. for baked playback
+    void AdvanceAnimation(float deltaTime)
+    {
+        if (animations.empty()) return;
+
+        playbackClock += deltaTime;
+        animationTime += deltaTime;
+        if (animationTime > animations[currentAnimation].GetDuration())
+            animationTime = fmod(animationTime, animations[currentAnimation].GetDuration());
+
+        if (isBlending)
+        {
+            previousAnimationTime += deltaTime;
+            if (previousAnimationTime > animations[previousAnimation].GetDuration())
+                previousAnimationTime = fmod(previousAnimationTime, animations[previousAnimation].GetDuration());
+
+            blendWeight += deltaTime / blendDuration;
+            if (blendWeight >= 1.0f)
+            {
+                blendWeight = 1.0f;
+                isBlending = false;
+            }
+        }
+
+        if (isInertializing)
+        {
+            inertialTime += deltaTime;
+            if (inertialTime >= blendDuration)
+                isInertializing = false;
+        }
+    }
+
+    // Samples a single clip at the given ratio into skinning matrices, leaving the playback state untouched
+    bool SampleClipPose(unsigned int animIndex, float ratio, std::vector<glm::mat4>& outMatrices)
+    {
+        if (!skeleton || animIndex >= animations.size()) return false;
+
+        ozz::animation::SamplingJob sampling;
+        sampling.animation = useClip(animIndex);
+        sampling.context = &poseContext;
+        sampling.ratio = ratio;
+        sampling.output = ozz::make_span(poseLocal);
+        if (!sampling.Run()) return false;
+
+        ozz::animation::LocalToModelJob ltmJob;
+        ltmJob.skeleton = skeleton.get();
+        ltmJob.input = ozz::make_span(poseLocal);
+        ltmJob.output = ozz::make_span(poseModelSpace);
+        if (!ltmJob.Run()) return false;
+
+        outMatrices.resize(palette.size());
+        for (size_t i = 0; i < palette.size(); ++i)
+            outMatrices[i] = OzzToGlmMat4(poseModelSpace[palette[i]]) * joints[palette[i]].invBindPose;
+
+        return true;
+    }
+
     void PlayAnimation(const std::string& animName, float duration = 0.2f)
     {
         auto it = animationsMap.find(animName);
@@ -172,32 +284,74 @@ public:
 
             // --- PHASE SYNC START ---
             // Calculate how far through the old animation we were (0.0 to 1.0)
-            float ratio = animationTime / animations[previousAnimation]->duration();
+            float ratio = animationTime / animations[previousAnimation].GetDuration();
 
             currentAnimation = it->second;
+            if (skeleton)
+                useClip(currentAnimation); // First play builds the clip
 
             // Start the new animation at the same relative spot
-            animationTime = ratio * animations[currentAnimation]->duration();
+            animationTime = ratio * animations[currentAnimation].GetDuration();
             // --- PHASE SYNC END ---
 
-            blendWeight = 0.0f;
             blendDuration = duration;
-            isBlending = true;
+            if (transitionMode == TransitionMode::INERTIALIZATION)
+                startInertialization();
+            else
+            {
+                blendWeight = 0.0f;
+                isBlending = true;
+            }
         }
     }
 
     void SetBoneTransformations(const Shader& shader)
+    {
+        SetBoneTransformations(shader, jointMatrices);
+    }
+
+    // Uploads an arbitrary palette-sized pose, e.g. one returned by SampleClipPose
+    void SetBoneTransformations(const Shader& shader, const std::vector<glm::mat4>& matrices)
     {
         shader.Use();
         shader.SetBool("animated", !animations.empty());
-        if (!animations.empty())
-            shader.SetMat4v("finalBonesMatrices", jointMatrices);
+        shader.SetBool("bakedAnimation", false);
+        if (animations.empty() || matrices.empty())
+            return;
+
+        if (shader.HasDefine("BONE_PALETTE_3X4"))
+        {
+            // Upload only the three meaningful rows of each affine matrix
+            paletteRows.resize(matrices.size() * 3);
+            for (size_t i = 0; i < matrices.size(); ++i)
+            {
+                const glm::mat4& m = matrices[i];
+                paletteRows[i * 3 + 0] = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+                paletteRows[i * 3 + 1] = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+                paletteRows[i * 3 + 2] = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+            }
+            shader.SetVec4v("finalBonesRows", paletteRows);
+        }
+        else
+            shader.SetMat4v("finalBonesMatrices", matrices);
     }
 
     const bool HasAnimations() { return !animations.empty(); }
     const unsigned int GetNumAnimations() { return (unsigned int)animations.size(); }
     std::map<std::string, unsigned int>& GetAnimationList() { return animationsMap; }
+    // Whether EvictAnimations() can free anything: only clips read from a baked model can be built again
+    bool CanEvictAnimations() const
+    {
+        return std::any_of(animations.begin(), animations.end(), [](const AnimationClip& clip) { return clip.CanRelease(); });
+    }
     const ozz::animation::Skeleton& GetSkeleton() const { return *skeleton; }
+    const unsigned int GetNumJoints() const { return numJoints; }
+    // Bumped every time new joint matrices are computed
+    const uint64_t GetPoseVersion() const { return poseVersion; }
+    const unsigned int GetPaletteSize() const { return (unsigned int)palette.size(); }
+    const unsigned int GetCurrentAnimation() const { return currentAnimation; }
+    const float GetAnimationTime() const { return animationTime; }
+    const float GetAnimationDuration(unsigned int animIndex) const { return animations[animIndex].GetDuration(); }
 
     void Debug()
     {
@@ -205,6 +359,7 @@ public:
             << ", hasAnimations: " << (HasAnimations() ? "yes" : "no")
             << ", numAnimations: " << GetNumAnimations()
             << ", bonesCount: " << numJoints
+            << ", paletteSize: " << palette.size()
             << ", meshes: " << meshes.size()
             << std::endl;
 
@@ -213,7 +368,7 @@ public:
         for (const auto& [name, index] : animationsMap)
             std::cout << "Animation: " << name
                 << ", Index: " << index
-                << ", Duration: " << animations[index]->duration()
+                << ", Duration: " << animations[index].GetDuration()
                 << std::endl;
     }
 
@@ -221,22 +376,123 @@ private:
     RuntimeSkeleton skeleton;
     std::vector<Joint> joints;
     unsigned int numJoints;
-    std::vector<RuntimeAnimation> animations;
+    std::vector<AnimationClip> animations;
+    std::vector<float> clipLastUsed; // playbackClock when each clip was last sampled
+    float playbackClock = 0.0f;
     std::map<std::string, unsigned int> animationsMap;
     ozz::animation::SamplingJob::Context context;
     ozz::animation::SamplingJob::Context previousContext;
+    ozz::animation::SamplingJob::Context poseContext;
 
     unsigned int previousAnimation = 0;
     unsigned int currentAnimation = 0;
     float blendWeight = 1.0f;
     float blendDuration = 0.5f;
     bool isBlending = false;
+    TransitionMode transitionMode = TransitionMode::CROSSFADE;
+    bool isInertializing = false;
+    float inertialTime = 0.0f;
     float previousAnimationTime = 0.0f;
     float animationTime = 0.0f;
+    uint64_t poseVersion = 0;
 
+    std::vector<int> palette;
+    std::vector<int> leafParentSlots; // Palette slot of the parent for maskable leaves, -1 otherwise
+    bool leafJointsDropped = false;
     std::vector<glm::mat4> jointMatrices;
+    std::vector<glm::vec4> paletteRows;
     std::vector<ozz::math::SoaTransform> currentLocal;
     std::vector<ozz::math::SoaTransform> previousLocal;
     std::vector<ozz::math::SoaTransform> blendedLocal;
+    std::vector<ozz::math::SoaTransform> inertialOffset; // Displayed pose minus the new clip, at the switch
     std::vector<ozz::math::Float4x4> modelSpaceTransforms;
+    std::vector<ozz::math::SoaTransform> poseLocal;
+    std::vector<ozz::math::Float4x4> poseModelSpace;
+
+    // Records the gap between the pose on screen and the new clip, once per switch
+    void startInertialization()
+    {
+        isBlending = false;
+        isInertializing = false;
+        if (!skeleton || poseVersion == 0 || blendDuration <= 0.0f) return;
+
+        ozz::animation::SamplingJob sampling;
+        sampling.animation = useClip(currentAnimation);
+        sampling.context = &context;
+        sampling.ratio = animationTime / animations[currentAnimation].GetDuration();
+        sampling.output = ozz::make_span(currentLocal);
+        if (!sampling.Run()) return;
+
+        using namespace ozz::math;
+        const SimdFloat4 zero = simd_float4::zero();
+        for (size_t i = 0; i < inertialOffset.size(); ++i)
+        {
+            const SoaTransform& from = blendedLocal[i];
+            const SoaTransform& to = currentLocal[i];
+            SoaTransform& offset = inertialOffset[i];
+
+            offset.translation = from.translation - to.translation;
+            offset.scale = from.scale - to.scale;
+
+            // Keep the rotation offset on the short arc, so it decays towards identity the short way
+            SoaQuaternion rotation = from.rotation * Conjugate(to.rotation);
+            const SimdInt4 flip = CmpLt(rotation.w, zero);
+            offset.rotation = { Select(flip, zero - rotation.x, rotation.x),
+                                Select(flip, zero - rotation.y, rotation.y),
+                                Select(flip, zero - rotation.z, rotation.z),
+                                Select(flip, zero - rotation.w, rotation.w) };
+        }
+
+        inertialTime = 0.0f;
+        isInertializing = true;
+    }
+
+    void applyInertialOffset()
+    {
+        using namespace ozz::math;
+
+        // Smoothstep decay: the offset fades out with zero velocity at both ends
+        float t = std::min(inertialTime / blendDuration, 1.0f);
+        const SimdFloat4 weight = simd_float4::Load1(1.0f - t * t * (3.0f - 2.0f * t));
+        const SoaQuaternion identity = SoaQuaternion::identity();
+
+        for (size_t i = 0; i < blendedLocal.size(); ++i)
+        {
+            const SoaTransform& offset = inertialOffset[i];
+            blendedLocal[i].translation = currentLocal[i].translation + offset.translation * weight;
+            blendedLocal[i].scale = currentLocal[i].scale + offset.scale * weight;
+            blendedLocal[i].rotation = NLerpEst(identity, offset.rotation, weight) * currentLocal[i].rotation;
+        }
+    }
+
+    const ozz::animation::Animation* useClip(unsigned int animIndex)
+    {
+        clipLastUsed[animIndex] = playbackClock;
+        return animations[animIndex].Get(*skeleton);
+    }
+
+    void buildLeafMask()
+    {
+        leafParentSlots.assign(palette.size(), -1);
+        if (!skeleton) return;
+
+        const auto parents = skeleton->joint_parents();
+        std::vector<bool> hasChildren(numJoints, false);
+        for (size_t j = 0; j < parents.size(); ++j)
+            if (parents[j] != ozz::animation::Skeleton::kNoParent)
+                hasChildren[parents[j]] = true;
+
+        std::vector<int> jointToSlot(numJoints, -1);
+        for (size_t i = 0; i < palette.size(); ++i)
+            jointToSlot[palette[i]] = (int)i;
+
+        // Only leaves whose parent is uploaded too can borrow its matrix
+        for (size_t i = 0; i < palette.size(); ++i)
+        {
+            int joint = palette[i];
+            int parent = parents[joint];
+            if (!hasChildren[joint] && parent != ozz::animation::Skeleton::kNoParent && jointToSlot[parent] >= 0)
+                leafParentSlots[i] = jointToSlot[parent];
+        }
+    }
 };
\ No newline at end of file
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "ozz/animation/offline/raw_animation.h"
+#include "ozz/animation/offline/animation_builder.h"
+#include "ozz/animation/offline/animation_optimizer.h"
+#include "ozz/animation/runtime/animation.h"
+#include "ozz/animation/runtime/skeleton.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+#include "ozz/base/memory/unique_ptr.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+
+using RawAnimation = ozz::animation::offline::RawAnimation;
+using RuntimeAnimation = ozz::unique_ptr<ozz::animation::Animation>;
+
+// Keyframe reduction tolerances handed to ozz's AnimationOptimizer
+struct AnimationCompression
+{
+    float Tolerance = 0.001f; // Maximum error in meters, measured on the joints' hierarchy
+    float Distance = 0.1f;    // Distance from the joint at which rotation and scale errors are measured
+};
+
+// ozz input stream over bytes owned elsewhere, e.g. a memory-mapped baked model
+class ReadOnlyMemoryStream : public ozz::io::Stream
+{
+public:
+    ReadOnlyMemoryStream(std::span<const unsigned char> bytes)
+        : bytes(bytes)
+    {}
+
+    bool opened() const override { return true; }
+
+    size_t Read(void* buffer, size_t size) override
+    {
+        size_t count = std::min(size, bytes.size() - position);
+        std::memcpy(buffer, bytes.data() + position, count);
+        position += count;
+        return count;
+    }
+
+    size_t Write(const void*, size_t) override { return 0; }
+
+    int Seek(int offset, Origin origin) override
+    {
+        long long base = origin == kSet ? 0 : origin == kCurrent ? (long long)position : (long long)bytes.size();
+        long long target = base + offset;
+        if (target < 0 || target > (long long)bytes.size())
+            return -1;
+        position = static_cast<size_t>(target);
+        return 0;
+    }
+
+    int Tell() const override { return static_cast<int>(position); }
+    size_t Size() const override { return bytes.size(); }
+
+private:
+    std::span<const unsigned char> bytes;
+    size_t position = 0;
+};
+
+// A clip known by name and duration up front, built into its runtime form the first time it is needed:
+// optimized from raw keyframes, or deserialized from a baked model. Share() hands the clip to another model:
+// the build state is shared, so the clip is built once for all of them and a failed build is not tried again.
+// Raw keyframes are let go once built, so only clips read from serialized bytes can drop their runtime form
+// again when unused; it is freed once every model sharing the clip has released it.
+class AnimationClip
+{
+public:
+    AnimationClip(std::shared_ptr<const RawAnimation> raw, const AnimationCompression& compression = {})
+        : name(raw->name), duration(raw->duration), source(std::make_shared<Source>())
+    {
+        source->raw = std::move(raw);
+        source->compression = compression;
+    }
+
+    // The owner keeps the serialized bytes alive for as long as the clip
+    AnimationClip(const std::string& name, float duration, std::shared_ptr<const void> owner,
+                  std::span<const unsigned char> serialized)
+        : name(name), duration(duration), source(std::make_shared<Source>())
+    {
+        source->owner = std::move(owner);
+        source->serialized = serialized;
+    }
+
+    AnimationClip(AnimationClip&&) = default;
+    AnimationClip& operator=(AnimationClip&&) = default;
+
+    const std::string& GetName() const { return name; }
+    float GetDuration() const { return duration; }
+
+    // Another clip over the same keyframes and build, e.g. for each enemy instanced from one import
+    AnimationClip Share() const
+    {
+        AnimationClip clip;
+        clip.name = name;
+        clip.duration = duration;
+        clip.source = source;
+        clip.runtime = runtime;
+        return clip;
+    }
+
+    bool IsBuilt() const { return runtime != nullptr; }
+    // Whether Release() can drop the runtime clip: it is built again from the serialized bytes
+    bool CanRelease() const { return !source->serialized.empty(); }
+
+    // Returns the runtime clip, building it if no clip sharing it has yet; nullptr if the build failed.
+    // Safe to call from any thread.
+    const ozz::animation::Animation* Get(const ozz::animation::Skeleton& skeleton)
+    {
+        if (!runtime)
+            runtime = source->Acquire(skeleton);
+        return runtime.get();
+    }
+
+    // Drops this model's hold on the runtime clip if CanRelease(), the next Get() deserializes it again
+    void Release()
+    {
+        if (CanRelease())
+            runtime.reset();
+    }
+
+private:
+    // Where the runtime clip comes from, and the clip once built, common to every clip from Share()
+    struct Source
+    {
+        std::mutex mutex;
+        std::shared_ptr<const RawAnimation> raw;
+        AnimationCompression compression;
+        std::shared_ptr<const void> owner;
+        std::span<const unsigned char> serialized;
+        std::weak_ptr<const ozz::animation::Animation> built;     // Freed when no clip holds it any more...
+        std::shared_ptr<const ozz::animation::Animation> pinned;  // ...unless it cannot be deserialized again
+        bool failed = false;
+
+        std::shared_ptr<const ozz::animation::Animation> Acquire(const ozz::animation::Skeleton& skeleton)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (auto animation = built.lock())
+                return animation;
+            if (failed)
+                return nullptr;
+
+            std::shared_ptr<const ozz::animation::Animation> animation =
+                raw ? build(*raw, compression, skeleton) : deserialize(serialized);
+            failed = !animation;
+            built = animation;
+            if (animation && raw)
+            {
+                pinned = animation;
+                raw.reset(); // The raw keyframes are much larger than the runtime clip
+            }
+            return animation;
+        }
+    };
+
+    std::string name;
+    float duration = 0.0f;
+    std::shared_ptr<Source> source;
+    std::shared_ptr<const ozz::animation::Animation> runtime;
+
+    AnimationClip() = default;
+
+    static RuntimeAnimation deserialize(std::span<const unsigned char> bytes)
+    {
+        ReadOnlyMemoryStream stream(bytes);
+        ozz::io::IArchive archive(&stream);
+        if (!archive.TestTag<ozz::animation::Animation>())
+        {
+            std::cerr << "Failed to read baked animation" << std::endl;
+            return nullptr;
+        }
+
+        auto animation = ozz::make_unique<ozz::animation::Animation>();
+        archive >> *animation;
+        return animation;
+    }
+
+    static RuntimeAnimation build(const RawAnimation& rawAnimation, const AnimationCompression& compression,
+                                  const ozz::animation::Skeleton& skeleton)
+    {
+        ozz::animation::offline::AnimationOptimizer optimizer;
+        optimizer.setting.tolerance = compression.Tolerance;
+        optimizer.setting.distance = compression.Distance;
+
+        ozz::animation::offline::RawAnimation optimizedRaw;
+        if (!optimizer(rawAnimation, skeleton, &optimizedRaw))
+        {
+            std::cerr << "Failed to optimize animation: " << rawAnimation.name << std::endl;
+            return nullptr;
+        }
+
+        ozz::animation::offline::AnimationBuilder animBuilder;
+        RuntimeAnimation animation = animBuilder(optimizedRaw);
+        if (!animation)
+        {
+            std::cerr << "Failed to build animation: " << rawAnimation.name << std::endl;
+            return nullptr;
+        }
+
+        std::cout << "Built animation: " << rawAnimation.name
+                  << ", keyframes: " << countKeyframes(rawAnimation) << " -> " << countKeyframes(optimizedRaw)
+                  << ", bytes: " << keyframeBytes(rawAnimation) << " -> " << keyframeBytes(optimizedRaw)
+                  << " (runtime " << animation->size() << ")" << std::endl;
+
+        return animation;
+    }
+
+    static size_t countKeyframes(const RawAnimation& animation)
+    {
+        size_t count = 0;
+        for (const auto& track : animation.tracks)
+            count += track.translations.size() + track.rotations.size() + track.scales.size();
+        return count;
+    }
+
+    static size_t keyframeBytes(const RawAnimation& animation)
+    {
+        size_t bytes = 0;
+        for (const auto& track : animation.tracks)
+            bytes += track.translations.size() * sizeof(RawAnimation::TranslationKey)
+                   + track.rotations.size() * sizeof(RawAnimation::RotationKey)
+                   + track.scales.size() * sizeof(RawAnimation::ScaleKey);
+        return bytes;
+    }
+};
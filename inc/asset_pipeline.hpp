@@ -0,0 +1,144 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+// Schedules asset loading coroutines: file reads and decodes go to the thread pool,
+// continuations touching OpenGL are queued for the GL thread and resumed there within a per-frame budget.
+//
+//     AssetTask LoadSomething()
+//     {
+//         co_await AssetPipeline::GetInstance().ResumeOnWorker();
+//         ... decode ...
+//         co_await AssetPipeline::GetInstance().ResumeOnGLThread();
+//         ... upload ...
+//     }
+class AssetPipeline
+{
+public:
+    // Delete copy constructor and assignment operator to enforce singleton
+    AssetPipeline(const AssetPipeline&) = delete;
+    AssetPipeline& operator=(const AssetPipeline&) = delete;
+
+    // Access the singleton instance
+    static AssetPipeline& GetInstance()
+    {
+        static AssetPipeline instance;
+        return instance;
+    }
+
+    // co_await it to continue on a worker thread
+    auto ResumeOnWorker()
+    {
+        struct Awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) const
+            {
+                ThreadPool::GetInstance().Submit([handle]() { handle.resume(); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{};
+    }
+
+    // co_await it to continue on the GL thread, during the next ProcessUploads()
+    auto ResumeOnGLThread()
+    {
+        struct Awaiter
+        {
+            AssetPipeline& pipeline;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) const
+            {
+                std::lock_guard<std::mutex> lock(pipeline.mutex);
+                pipeline.glQueue.push_back(handle);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this };
+    }
+
+    // Called once per frame on the GL thread: resumes queued continuations until the budget is spent.
+    // At least one runs every frame, so a single large upload cannot stall the queue.
+    void ProcessUploads(float budgetMilliseconds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (glQueue.empty())
+                    return;
+                handle = glQueue.front();
+                glQueue.pop_front();
+            }
+            handle.resume();
+        } while (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < budgetMilliseconds);
+    }
+
+    // Runs every pending task to completion, e.g. before tearing down what they load into
+    void Finish()
+    {
+        while (!IsIdle())
+        {
+            ProcessUploads(std::numeric_limits<float>::max());
+            std::this_thread::yield();
+        }
+    }
+
+    bool IsIdle() const { return pendingTasks == 0; }
+    int GetPendingTasks() const { return pendingTasks; }
+
+private:
+    friend struct AssetTask;
+
+    std::deque<std::coroutine_handle<>> glQueue;
+    std::mutex mutex;
+    std::atomic<int> pendingTasks = 0;
+
+    AssetPipeline() = default;
+};
+
+// Return type of asset loading coroutines: starts right away and runs to completion on its own,
+// nobody waits on it. AssetPipeline::IsIdle() tells when every started task is done.
+struct AssetTask
+{
+    struct promise_type
+    {
+        promise_type() { ++AssetPipeline::GetInstance().pendingTasks; }
+        ~promise_type() { --AssetPipeline::GetInstance().pendingTasks; }
+
+        AssetTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            try
+            {
+                std::rethrow_exception(std::current_exception());
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "ERROR::ASSET_PIPELINE: " << e.what() << std::endl;
+            }
+            catch (...)
+            {
+                std::cerr << "ERROR::ASSET_PIPELINE: Unknown exception in loading task" << std::endl;
+            }
+        }
+    };
+};
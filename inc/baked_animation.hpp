@@ -0,0 +1,156 @@
+#pragma once
+
+#include "animated_model.hpp"
+#include "render_state.hpp"
+#include "shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+constexpr float DEFAULT_BAKED_SAMPLE_RATE = 30.0f;
+constexpr GLuint BAKED_POSES_TEXTURE_UNIT = 3;
+
+struct BakedClip
+{
+    int firstFrame; // Row of the first frame inside the pose texture
+    int numFrames;
+    float duration;
+};
+
+// Frames sampled for a BakedAnimation, on the CPU only so that the sampling can run on a worker thread
+struct BakedPoses
+{
+    float sampleRate = DEFAULT_BAKED_SAMPLE_RATE;
+    int width = 0, height = 0; // In texels: 3 per palette joint, one row per frame
+    std::vector<BakedClip> clips;
+    std::vector<glm::vec4> texels;
+};
+
+// Samples every clip of an AnimatedModel at a fixed rate into a joint-matrix texture.
+// Each row holds one frame, each palette joint takes 3 RGBA32F texels (the rows of its 3x4 affine matrix),
+// so the vertex shader can reconstruct the pose from the clip and time alone.
+class BakedAnimation
+{
+public:
+    // Uploads the frames from Sample(), call it from the GL thread only
+    BakedAnimation(const BakedPoses& poses)
+        : sampleRate(poses.sampleRate), clips(poses.clips)
+    {
+        upload(poses);
+    }
+
+    ~BakedAnimation()
+    {
+        RenderState::GetInstance().DeleteTexture(texture);
+    }
+
+    BakedAnimation(const BakedAnimation&) = delete;
+    BakedAnimation& operator=(const BakedAnimation&) = delete;
+
+    // Samples every clip of the model and stores the transposed 3x4 joint matrices. No GL: the model can be
+    // one without meshes, see ModelLoader::InstantiateAnimation().
+    static BakedPoses Sample(AnimatedModel& model, float sampleRate = DEFAULT_BAKED_SAMPLE_RATE)
+    {
+        BakedPoses poses;
+        poses.sampleRate = sampleRate;
+        unsigned int numAnimations = model.GetNumAnimations();
+        unsigned int numJoints = model.GetPaletteSize();
+        if (numAnimations == 0 || numJoints == 0) return poses;
+
+        // 1. Lay out every clip's frames one after the other
+        for (unsigned int i = 0; i < numAnimations; ++i)
+        {
+            float duration = model.GetAnimationDuration(i);
+            int numFrames = std::max(1, static_cast<int>(std::ceil(duration * sampleRate)));
+            poses.clips.push_back({ poses.height, numFrames, duration });
+            poses.height += numFrames;
+        }
+
+        // 2. Sample each frame
+        poses.width = static_cast<int>(numJoints) * 3;
+        poses.texels.resize(static_cast<size_t>(poses.width) * poses.height);
+        std::vector<glm::mat4> pose;
+
+        for (unsigned int i = 0; i < numAnimations; ++i)
+        {
+            const BakedClip& clip = poses.clips[i];
+            for (int f = 0; f < clip.numFrames; ++f)
+            {
+                // At the time playback reads the frame, see SetBoneTransformations()
+                float ratio = clip.duration > 0.0f ? std::min(static_cast<float>(f) / sampleRate, clip.duration) / clip.duration : 0.0f;
+                if (!model.SampleClipPose(i, ratio, pose))
+                {
+                    std::cerr << "ERROR::BAKED_ANIMATION: Failed to sample clip " << i << ", frame " << f << std::endl;
+                    continue;
+                }
+
+                glm::vec4* row = &poses.texels[static_cast<size_t>(clip.firstFrame + f) * poses.width];
+                for (unsigned int j = 0; j < numJoints; ++j)
+                {
+                    glm::mat4 rows = glm::transpose(pose[j]);
+                    row[j * 3 + 0] = rows[0];
+                    row[j * 3 + 1] = rows[1];
+                    row[j * 3 + 2] = rows[2];
+                }
+            }
+        }
+        return poses;
+    }
+
+    // Binds the pose texture and selects the two frames to interpolate for the given clip and time
+    void SetBoneTransformations(const Shader& shader, unsigned int animIndex, float time) const
+    {
+        if (animIndex >= clips.size()) return;
+
+        // Frame f holds the pose at f / sampleRate. The last frame blends into the first over what is left of the
+        // clip, shorter than a sample period when duration * sampleRate is not a whole number.
+        const BakedClip& clip = clips[animIndex];
+        float clipTime = clip.duration > 0.0f ? std::fmod(time, clip.duration) : 0.0f;
+        int frame0 = std::min(static_cast<int>(std::floor(clipTime * sampleRate)), clip.numFrames - 1);
+        int frame1 = (frame0 + 1) % clip.numFrames;
+        float frameStart = static_cast<float>(frame0) / sampleRate;
+        float frameEnd = std::min(static_cast<float>(frame0 + 1) / sampleRate, clip.duration);
+        float blend = frameEnd > frameStart ? std::clamp((clipTime - frameStart) / (frameEnd - frameStart), 0.0f, 1.0f) : 0.0f;
+
+        shader.Use();
+        shader.SetBool("animated", true);
+        shader.SetBool("bakedAnimation", true);
+        shader.SetInt("bakedFrame0", clip.firstFrame + frame0);
+        shader.SetInt("bakedFrame1", clip.firstFrame + frame1);
+        shader.SetFloat("bakedFrameBlend", blend);
+
+        RenderState::GetInstance().BindTexture(BAKED_POSES_TEXTURE_UNIT, GL_TEXTURE_2D, texture);
+    }
+
+    const BakedClip& GetClip(unsigned int animIndex) const { return clips[animIndex]; }
+    unsigned int GetNumClips() const { return (unsigned int)clips.size(); }
+
+private:
+    GLuint texture = 0;
+    float sampleRate;
+    std::vector<BakedClip> clips;
+
+    void upload(const BakedPoses& poses)
+    {
+        if (poses.texels.empty()) return;
+
+        // Float texture, fetched with texelFetch so no filtering is needed
+        RenderState& state = RenderState::GetInstance();
+        glGenTextures(1, &texture);
+        state.BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, poses.width, poses.height, 0, GL_RGBA, GL_FLOAT, poses.texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state.BindTexture(GL_TEXTURE_2D, 0);
+
+        std::cout << "Baked " << clips.size() << " animations, " << poses.height << " frames, "
+                  << (poses.texels.size() * sizeof(glm::vec4)) / 1024 << " KB" << std::endl;
+    }
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "animation_clip.hpp"
+#include "mapped_file.hpp"
+#include "model_data.hpp"
+
+#include "ozz/animation/runtime/skeleton.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+constexpr char BAKED_MODEL_MAGIC[4] = { 'D', 'K', 'M', 'B' };
+constexpr uint32_t BAKED_MODEL_VERSION = 3; // 2: meshes optimized for the vertex cache, 3: LOD chains
+constexpr const char* BAKED_MODEL_EXTENSION = ".dkm";
+
+// Layout of a baked model, every offset is from the start of the file and 16-byte aligned:
+// header | mesh table | texture table | clip table | blobs (vertices, indices, strings, ozz archives...)
+struct BakedModelHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize; // sizeof(Vertex) at bake time: the blobs are mapped as they are and packed on upload
+    uint32_t numMeshes, numTextures, numClips;
+    uint32_t numJoints, numPaletteJoints;
+    uint64_t skeletonOffset, skeletonSize; // ozz archive, empty for static models
+    uint64_t invBindPosesOffset;           // numJoints glm::mat4
+    uint64_t paletteOffset;                // numPaletteJoints int32_t
+};
+
+struct BakedMesh
+{
+    uint64_t verticesOffset, numVertices;
+    uint64_t indicesOffset, numIndices;
+    uint64_t texturesOffset, numTextures; // uint32_t indices into the texture table
+    uint64_t lodsOffset, numLods;         // MeshLod ranges of the indices
+};
+
+struct BakedTexture
+{
+    uint64_t typeOffset, typeSize;
+    uint64_t pathOffset, pathSize;
+    uint64_t embeddedOffset, embeddedSize;
+    uint32_t embeddedWidth, embeddedHeight;
+};
+
+struct BakedModelClip
+{
+    uint64_t nameOffset, nameSize;
+    uint64_t dataOffset, dataSize; // ozz archive of the optimized runtime animation
+    float duration;
+    uint32_t padding;
+};
+
+// Reads and writes the fast-load model format produced by dunkelheit_bake.
+// Reading maps the file and points the model data into it: no Assimp, no ozz offline builders.
+class BakedModelFile
+{
+public:
+    static std::string PathFor(const std::string& sourcePath)
+    {
+        return std::filesystem::path(sourcePath).replace_extension(BAKED_MODEL_EXTENSION).string();
+    }
+
+    // A baked model is only used when it is at least as recent as its source
+    static bool IsUpToDate(const std::string& bakedPath, const std::string& sourcePath)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(bakedPath, error))
+            return false;
+        if (!std::filesystem::exists(sourcePath, error))
+            return true;
+        return std::filesystem::last_write_time(bakedPath, error) >= std::filesystem::last_write_time(sourcePath, error);
+    }
+
+    static bool Read(const std::string& path, ModelData& data)
+    {
+        auto file = std::make_shared<const MappedFile>(path);
+        if (!file->IsOpen() || file->GetSize() < sizeof(BakedModelHeader))
+            return false;
+
+        // Every view is bounds checked against the file, a truncated bake is rejected as a whole
+        bool valid = true;
+
+        const BakedModelHeader& header = *reinterpret_cast<const BakedModelHeader*>(file->GetData());
+        if (std::memcmp(header.magic, BAKED_MODEL_MAGIC, sizeof(BAKED_MODEL_MAGIC)) != 0 ||
+            header.version != BAKED_MODEL_VERSION || header.vertexSize != sizeof(Vertex))
+        {
+            std::cerr << "ERROR::BAKED_MODEL: Incompatible baked model " << path << std::endl;
+            return false;
+        }
+
+        uint64_t tableOffset = sizeof(BakedModelHeader);
+        auto meshes = view<BakedMesh>(*file, tableOffset, header.numMeshes, valid);
+        tableOffset += header.numMeshes * sizeof(BakedMesh);
+        auto textures = view<BakedTexture>(*file, tableOffset, header.numTextures, valid);
+        tableOffset += header.numTextures * sizeof(BakedTexture);
+        auto clips = view<BakedModelClip>(*file, tableOffset, header.numClips, valid);
+
+        data.path = path;
+        data.directory = std::filesystem::path(path).parent_path().string();
+
+        for (const auto& mesh : meshes)
+        {
+            MeshData meshData;
+            meshData.mappedVertices = view<Vertex>(*file, mesh.verticesOffset, mesh.numVertices, valid);
+            meshData.mappedIndices = view<GLuint>(*file, mesh.indicesOffset, mesh.numIndices, valid);
+            for (uint32_t texture : view<uint32_t>(*file, mesh.texturesOffset, mesh.numTextures, valid))
+                meshData.textures.push_back(texture);
+            for (const MeshLod& lod : view<MeshLod>(*file, mesh.lodsOffset, mesh.numLods, valid))
+                meshData.lods.push_back(lod);
+            data.meshes.push_back(std::move(meshData));
+        }
+
+        for (const auto& texture : textures)
+        {
+            TextureData textureData{ string(*file, texture.typeOffset, texture.typeSize, valid),
+                                     string(*file, texture.pathOffset, texture.pathSize, valid) };
+            auto embedded = view<unsigned char>(*file, texture.embeddedOffset, texture.embeddedSize, valid);
+            textureData.embedded.assign(embedded.begin(), embedded.end());
+            textureData.embeddedWidth = texture.embeddedWidth;
+            textureData.embeddedHeight = texture.embeddedHeight;
+            data.textures.push_back(std::move(textureData));
+        }
+
+        if (header.skeletonSize > 0)
+        {
+            ReadOnlyMemoryStream stream(view<unsigned char>(*file, header.skeletonOffset, header.skeletonSize, valid));
+            ozz::io::IArchive archive(&stream);
+            if (!valid || !archive.TestTag<ozz::animation::Skeleton>())
+            {
+                std::cerr << "ERROR::BAKED_MODEL: Invalid skeleton in " << path << std::endl;
+                return false;
+            }
+            data.skeleton = ozz::make_unique<ozz::animation::Skeleton>();
+            archive >> *data.skeleton;
+
+            // Names and parents come from the skeleton, only the inverse bind poses are stored
+            auto invBindPoses = view<glm::mat4>(*file, header.invBindPosesOffset, header.numJoints, valid);
+            if (invBindPoses.size() != static_cast<size_t>(data.skeleton->num_joints()))
+                valid = false;
+            for (size_t i = 0; i < invBindPoses.size() && valid; ++i)
+            {
+                data.joints.push_back({
+                    .name           = data.skeleton->joint_names()[i],
+                    .parentIndex    = data.skeleton->joint_parents()[i],
+                    .localTransform = ozz::math::Transform::identity(),
+                    .invBindPose    = invBindPoses[i]
+                });
+            }
+
+            for (int32_t joint : view<int32_t>(*file, header.paletteOffset, header.numPaletteJoints, valid))
+                data.palette.push_back(joint);
+
+            // Clips stay serialized in the mapping until they are first played
+            for (const auto& clip : clips)
+            {
+                data.animations.emplace_back(string(*file, clip.nameOffset, clip.nameSize, valid), clip.duration, file,
+                                             view<unsigned char>(*file, clip.dataOffset, clip.dataSize, valid));
+            }
+        }
+
+        if (!valid)
+        {
+            std::cerr << "ERROR::BAKED_MODEL: Truncated baked model " << path << std::endl;
+            data = ModelData();
+            return false;
+        }
+
+        data.mapping = file;
+        return true;
+    }
+
+    // Builds every clip and writes the whole model out, called by dunkelheit_bake
+    static bool Write(const std::string& path, ModelData& data)
+    {
+        std::vector<std::vector<unsigned char>> clipArchives;
+        std::vector<unsigned char> skeletonArchive;
+        if (data.skeleton)
+        {
+            skeletonArchive = serialize(*data.skeleton);
+            for (auto& clip : data.animations)
+            {
+                const ozz::animation::Animation* animation = clip.Get(*data.skeleton);
+                if (!animation)
+                    return false;
+                clipArchives.push_back(serialize(*animation));
+            }
+        }
+
+        BakedModelHeader header = {};
+        std::memcpy(header.magic, BAKED_MODEL_MAGIC, sizeof(BAKED_MODEL_MAGIC));
+        header.version = BAKED_MODEL_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.numMeshes = static_cast<uint32_t>(data.meshes.size());
+        header.numTextures = static_cast<uint32_t>(data.textures.size());
+        header.numClips = static_cast<uint32_t>(clipArchives.size());
+        header.numJoints = data.skeleton ? static_cast<uint32_t>(data.joints.size()) : 0;
+        header.numPaletteJoints = data.skeleton ? static_cast<uint32_t>(data.palette.size()) : 0;
+
+        std::vector<BakedMesh> meshes(data.meshes.size());
+        std::vector<BakedTexture> textures(data.textures.size());
+        std::vector<BakedModelClip> clips(clipArchives.size());
+
+        // Blobs go after the tables
+        std::vector<unsigned char> file(sizeof(BakedModelHeader) + meshes.size() * sizeof(BakedMesh) +
+                                        textures.size() * sizeof(BakedTexture) + clips.size() * sizeof(BakedModelClip));
+        auto append = [&file](const void* bytes, size_t size) -> uint64_t
+        {
+            file.resize((file.size() + 15) & ~size_t(15));
+            uint64_t offset = file.size();
+            const unsigned char* begin = static_cast<const unsigned char*>(bytes);
+            file.insert(file.end(), begin, begin + size);
+            return offset;
+        };
+
+        for (size_t i = 0; i < data.meshes.size(); ++i)
+        {
+            const MeshData& mesh = data.meshes[i];
+            auto vertices = mesh.GetVertices();
+            auto indices = mesh.GetIndices();
+            std::vector<uint32_t> meshTextures(mesh.textures.begin(), mesh.textures.end());
+
+            meshes[i].verticesOffset = append(vertices.data(), vertices.size_bytes());
+            meshes[i].numVertices = vertices.size();
+            meshes[i].indicesOffset = append(indices.data(), indices.size_bytes());
+            meshes[i].numIndices = indices.size();
+            meshes[i].texturesOffset = append(meshTextures.data(), meshTextures.size() * sizeof(uint32_t));
+            meshes[i].numTextures = meshTextures.size();
+            meshes[i].lodsOffset = append(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            meshes[i].numLods = mesh.lods.size();
+        }
+
+        for (size_t i = 0; i < data.textures.size(); ++i)
+        {
+            const TextureData& texture = data.textures[i];
+            textures[i].typeOffset = append(texture.type.data(), texture.type.size());
+            textures[i].typeSize = texture.type.size();
+            textures[i].pathOffset = append(texture.path.data(), texture.path.size());
+            textures[i].pathSize = texture.path.size();
+            textures[i].embeddedOffset = append(texture.embedded.data(), texture.embedded.size());
+            textures[i].embeddedSize = texture.embedded.size();
+            textures[i].embeddedWidth = texture.embeddedWidth;
+            textures[i].embeddedHeight = texture.embeddedHeight;
+        }
+
+        if (data.skeleton)
+        {
+            header.skeletonOffset = append(skeletonArchive.data(), skeletonArchive.size());
+            header.skeletonSize = skeletonArchive.size();
+
+            std::vector<glm::mat4> invBindPoses;
+            for (const auto& joint : data.joints)
+                invBindPoses.push_back(joint.invBindPose);
+            header.invBindPosesOffset = append(invBindPoses.data(), invBindPoses.size() * sizeof(glm::mat4));
+
+            std::vector<int32_t> palette(data.palette.begin(), data.palette.end());
+            header.paletteOffset = append(palette.data(), palette.size() * sizeof(int32_t));
+
+            for (size_t i = 0; i < clipArchives.size(); ++i)
+            {
+                const std::string& name = data.animations[i].GetName();
+                clips[i].nameOffset = append(name.data(), name.size());
+                clips[i].nameSize = name.size();
+                clips[i].dataOffset = append(clipArchives[i].data(), clipArchives[i].size());
+                clips[i].dataSize = clipArchives[i].size();
+                clips[i].duration = data.animations[i].GetDuration();
+            }
+        }
+
+        // Fill in the header and tables
+        unsigned char* table = file.data();
+        std::memcpy(table, &header, sizeof(header));
+        table += sizeof(header);
+        std::memcpy(table, meshes.data(), meshes.size() * sizeof(BakedMesh));
+        table += meshes.size() * sizeof(BakedMesh);
+        std::memcpy(table, textures.data(), textures.size() * sizeof(BakedTexture));
+        table += textures.size() * sizeof(BakedTexture);
+        std::memcpy(table, clips.data(), clips.size() * sizeof(BakedModelClip));
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cerr << "ERROR::BAKED_MODEL: Failed to open " << path << " for writing" << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+
+        std::cout << "Baked " << path << ": " << data.meshes.size() << " meshes, " << data.textures.size() << " textures, "
+                  << clipArchives.size() << " animations, " << file.size() / 1024 << " KB" << std::endl;
+        return static_cast<bool>(out);
+    }
+
+private:
+    template <typename T>
+    static std::span<const T> view(const MappedFile& file, uint64_t offset, uint64_t count, bool& valid)
+    {
+        if (offset > file.GetSize() || count > (file.GetSize() - offset) / sizeof(T))
+        {
+            valid = false;
+            return {};
+        }
+        return { reinterpret_cast<const T*>(file.GetData() + offset), static_cast<size_t>(count) };
+    }
+
+    static std::string string(const MappedFile& file, uint64_t offset, uint64_t size, bool& valid)
+    {
+        auto chars = view<char>(file, offset, size, valid);
+        return std::string(chars.begin(), chars.end());
+    }
+
+    template <typename T>
+    static std::vector<unsigned char> serialize(const T& object)
+    {
+        ozz::io::MemoryStream stream;
+        ozz::io::OArchive archive(&stream);
+        archive << object;
+
+        std::vector<unsigned char> bytes(stream.Size());
+        stream.Seek(0, ozz::io::Stream::kSet);
+        stream.Read(bytes.data(), bytes.size());
+        return bytes;
+    }
+};
@@ -3,6 +3,9 @@
 #include "mesh.hpp"
 #include "shader.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <utility>
 #include <vector>
 
 class BasicModel
@@ -10,9 +13,36 @@ class BasicModel
 public:
     virtual void Draw(const Shader& shader) const = 0;
 
-    void AddMesh(const Mesh& mesh)
+    void AddMesh(Mesh&& mesh)
     {
-        meshes.emplace_back(mesh);
+        meshes.push_back(std::move(mesh));
+    }
+
+    const std::vector<Mesh>& GetMeshes() const { return meshes; }
+
+    // Level of detail the meshes are drawn with
+    void SetLod(int level) { lod = level; }
+    int GetLod() const { return lod; }
+
+    // Longest LOD chain of the meshes
+    int GetNumLods() const
+    {
+        int numLods = 1;
+        for (const auto& mesh : meshes)
+            numLods = std::max(numLods, mesh.GetNumLods());
+        return numLods;
+    }
+
+    // Bind pose bounding box of all the meshes
+    void GetBounds(glm::vec3& min, glm::vec3& max) const
+    {
+        min = glm::vec3(std::numeric_limits<float>::max());
+        max = glm::vec3(std::numeric_limits<float>::lowest());
+        for (const auto& mesh : meshes)
+        {
+            min = glm::min(min, mesh.GetBoundsMin());
+            max = glm::max(max, mesh.GetBoundsMax());
+        }
     }
 
     void Debug() const
@@ -24,4 +54,5 @@ public:
 
 protected:
     std::vector<Mesh> meshes;
+    int lod = 0;
 };
@@ -3,11 +3,12 @@
 #include "basic_model.hpp"
 #include "mesh.hpp"
 #include "shader.hpp"
+#include "texture_cache.hpp"
 
 #include <string>
 #include <vector>
 
-class CubeModel : BasicModel
+class CubeModel : public BasicModel
 {
 public:
     CubeModel(const std::string& texturePath)
@@ -75,11 +76,10 @@ private:
         }
 
         // Texture setup
-        std::vector<Texture> textures = {
-            { Texture2D(texturePath), "texture_diffuse" }
-        };
+        std::vector<Texture> textures;
+        textures.push_back({ TextureCache::GetInstance().Acquire(texturePath), "texture_diffuse", texturePath });
 
         // Add the mesh
-        AddMesh({ vertices, indices, textures });
+        AddMesh({ vertices, indices, std::move(textures) });
     }
 };
\ No newline at end of file
@@ -2,18 +2,29 @@
 
 #include "animated_model.hpp"
 #include "audio_engine.hpp"
+#include "baked_animation.hpp"
 #include "entity.hpp"
 #include "fps_camera.hpp"
+#include "impostor_atlas.hpp"
 #include "level.hpp"
+#include "mesh_lod.hpp"
 #include "model_loader.hpp"
 #include "plane_model.hpp"
+#include "render_queue.hpp"
+#include "skinning_cache.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 enum class EnemyState {
@@ -25,16 +36,38 @@ enum class EnemyState {
     ATTACK
 };
 
+// How often an enemy's pose is re-evaluated, depending on its distance from the camera
+struct AnimationLOD
+{
+    float FullRateDistance = 0.0f;  // Closer than this the pose is evaluated every frame
+    float MinRateDistance = 0.0f;   // From here on the pose is evaluated at MinUpdateRate
+    float MinUpdateRate = 0.0f;     // Evaluations per second, 0 evaluates every frame at any distance
+    float LeafJointDistance = 0.0f; // Beyond this the leaf joints are masked, 0 never masks them
+    bool CullOffscreen = false;     // Hold the pose while the enemy is outside the view
+};
+
 class Enemy : public Entity
 {
 public:
-    Enemy(const std::string& modelPath, const glm::vec3 position, const float initialAngleY, const glm::vec3 scaleFactor)
+    // Played by Reset(), so the clip every enemy needs first
+    static constexpr const char* INITIAL_ANIMATION = "2_idle";
+
+    Enemy(const std::string& modelPath, const glm::vec3 position, const float initialAngleY, const glm::vec3 scaleFactor,
+          const AnimationCompression& compression = {})
+          : Enemy(loadModelData(modelPath, compression), position, initialAngleY, scaleFactor)
+    {}
+
+    // Instances a model loaded ahead of time, sharing its skeleton and clips with the other enemies made from it
+    Enemy(const ModelData& modelData, const glm::vec3 position, const float initialAngleY, const glm::vec3 scaleFactor)
           : currentPosition(position), initialPosition(position), scaleFactor(scaleFactor), initialAngleY(initialAngleY), currentState(EnemyState::IDLE)
     {
         enemyModel = std::make_unique<AnimatedModel>();
-        ModelLoader& gltf = ModelLoader::GetInstance();
-        gltf.LoadFromFile(modelPath, *enemyModel);
-        blobShadow = std::make_unique<PlaneModel>("assets/blob_shadow.png");
+        ModelLoader::GetInstance().Instantiate(modelData, *enemyModel);
+
+        glm::vec3 boundsMin, boundsMax;
+        enemyModel->GetBounds(boundsMin, boundsMax);
+        boundsCenter = (boundsMin + boundsMax) * 0.5f;
+        boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
 
         Reset();
         updateModelMatrix();
@@ -84,38 +117,128 @@ public:
         handleStateLogic(deltaTime, camera.Position);
 
         updateModelMatrix();
-        enemyModel->UpdateAnimation(deltaTime);
+        enemyModel->SetLod(meshLOD.Select(projectedSize(camera), enemyModel->GetNumLods()));
+
+        // 5. Far away enemies play the baked poses or become sprites: only the timeline advances on the CPU
+        cameraPosition = camera.Position;
+        impostorBlend = impostors ? glm::clamp((distToPlayer - impostorDistance) / impostorFadeBand, 0.0f, 1.0f) : 0.0f;
+        bakedPlayback = bakedAnimation && distToPlayer > bakedAnimationDistance;
+        enemyModel->AdvanceAnimation(deltaTime);
+        if (animationEvictAfter > 0.0f)
+            enemyModel->EvictAnimations(animationEvictAfter);
+        poseAge += deltaTime;
+        if (bakedPlayback || impostorBlend >= 1.0f)
+            return;
+
+        // 6. Animation LOD: the pose is held between evaluations and while off-screen
+        if (animationLOD.CullOffscreen && !isInView(camera))
+            return;
+        if (poseAge < poseUpdateInterval(distToPlayer))
+            return;
+
+        enemyModel->SetLeafJointsDropped(animationLOD.LeafJointDistance > 0.0f && distToPlayer > animationLOD.LeafJointDistance);
+        enemyModel->EvaluatePose();
+        poseAge = 0.0f;
     }
 
-    void Draw(const Shader& shader) const override
+    void Submit(RenderQueue& queue) const override
     {
-        // 1. Draw the Enemy Model as usual
+        // The bounding sphere, around the model origin, for the queue's distance culling
+        float cullRadius = (glm::length(boundsCenter) + boundsRadius) * std::max(scaleFactor.x, std::max(scaleFactor.y, scaleFactor.z));
+
+        // 1. The model, fading out inside the impostor band
+        if (impostorBlend < 1.0f)
+            queue.SubmitCustom(impostorBlend > 0.0f ? RenderPass::Transparent : RenderPass::Opaque, *this, MODEL_PART, currentPosition)
+                .cullRadius = cullRadius;
+
+        // 2. Far away: camera-facing sprite picked from the impostor atlas
+        if (impostorBlend > 0.0f)
+            queue.SubmitCustom(RenderPass::Transparent, *this, IMPOSTOR_PART, currentPosition).cullRadius = cullRadius;
+
+        // 3. Blob shadow slightly above the floor (no z-fighting), at ground level whatever the enemy's Y.
+        // No depth writes, so shadows don't clip each other or the floor.
+        if (!blobShadow)
+            return;
+        glm::mat4 shadowModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(currentPosition.x, 0.01f, currentPosition.z));
+        shadowModelMatrix = glm::scale(shadowModelMatrix, glm::vec3(2.0f));
+        for (const auto& mesh : blobShadow->GetMeshes())
+            queue.SubmitMesh(RenderPass::Transparent, mesh, shadowModelMatrix).depthWrite = false;
+    }
+
+    void DrawCustom(const Shader& shader, uint32_t part) const override
+    {
+        if (part == IMPOSTOR_PART)
+        {
+            unsigned int animIndex = enemyModel->GetCurrentAnimation();
+            impostors->Draw(shader, currentPosition, currentRotation, scaleFactor, cameraPosition,
+                            animIndex, enemyModel->GetAnimationTime(), enemyModel->GetAnimationDuration(animIndex), impostorBlend);
+            return;
+        }
+
         shader.Use();
+        shader.SetFloat("opacity", 1.0f - impostorBlend);
         shader.SetMat4("modelMatrix", modelMatrix);
         shader.SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(modelMatrix))));
-        enemyModel->SetBoneTransformations(shader);
-        enemyModel->Draw(shader);
+        if (skinningCache && skinningCache->IsValid())
+            skinningCache->Draw(shader);
+        else
+        {
+            setBoneTransformations(shader);
+            enemyModel->Draw(shader);
+        }
+        shader.SetFloat("opacity", 1.0f);
+    }
 
-        // 2. Prepare for Transparent Shadow
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Every enemy draws the same blob shadow: the queue merges them into one instanced draw
+    void SetBlobShadow(std::shared_ptr<const PlaneModel> shadow)
+    {
+        blobShadow = std::move(shadow);
+    }
 
-        // Disable depth writing so shadows don't clip each other or the floor
-        glDepthMask(GL_FALSE);
+    // Skins the vertices once into the cache, unless the pose is the same as last time (paused, frozen...)
+    void Skin(const Shader& skinningShader)
+    {
+        if (!skinningCache || impostorBlend >= 1.0f) return;
 
-        // Calculate shadow position (slightly above the floor to avoid z-fighting)
-        // We ignore the enemy's current Y and put it at ground level (e.g., 0.01)
-        glm::vec3 shadowPos = glm::vec3(currentPosition.x, 0.01f, currentPosition.z);
+        uint64_t poseKey = bakedPlayback
+            ? (1ull << 63) | (uint64_t(enemyModel->GetCurrentAnimation()) << 32) | std::bit_cast<uint32_t>(enemyModel->GetAnimationTime())
+            : enemyModel->GetPoseVersion();
 
-        glm::mat4 shadowModelMatrix = glm::translate(glm::mat4(1.0f), shadowPos);
-        shadowModelMatrix = glm::scale(shadowModelMatrix, glm::vec3(2.0f));
+        if (!skinningCache->NeedsUpdate(poseKey)) return;
+
+        setBoneTransformations(skinningShader);
+        skinningCache->Capture(skinningShader, poseKey);
+    }
 
-        shader.SetMat4("modelMatrix", shadowModelMatrix);
-        blobShadow->Draw(shader);
+    // Beyond distance the enemy is drawn as a sprite, crossfading with the mesh over fadeBand
+    void SetImpostors(std::shared_ptr<ImpostorAtlas> atlas, float distance, float fadeBand)
+    {
+        impostors = std::move(atlas);
+        impostorDistance = distance;
+        impostorFadeBand = std::max(fadeBand, 0.001f);
+    }
 
-        // Re-enable depth writing for the next object in the frame
-        glDepthMask(GL_TRUE);
-        glDisable(GL_BLEND);
+    // Clips that have not played for the given number of seconds are released, 0 keeps them all.
+    // Off when the clips cannot be released, see AnimatedModel::CanEvictAnimations().
+    void SetAnimationEviction(float idleTime)
+    {
+        animationEvictAfter = enemyModel->CanEvictAnimations() ? idleTime : 0.0f;
+    }
+
+    void SetAnimationLOD(const AnimationLOD& lod)
+    {
+        animationLOD = lod;
+    }
+
+    // Mesh LOD picked from the projected size of the enemy, see LodSelector
+    void SetMeshLOD(float screenSize, float hysteresis)
+    {
+        meshLOD = LodSelector(screenSize, hysteresis);
+    }
+
+    void EnableSkinningCache()
+    {
+        skinningCache = std::make_unique<SkinningCache>(*enemyModel);
     }
 
     void ToggleSound(const bool pause)
@@ -128,7 +251,7 @@ public:
 
     void Reset()
     {
-        enemyModel->PlayAnimation("2_idle", 0.5f);
+        enemyModel->PlayAnimation(INITIAL_ANIMATION, 0.5f);
         setState(EnemyState::IDLE);
         currentPosition = initialPosition;
         currentRotation = glm::angleAxis(glm::radians(initialAngleY), glm::vec3(0.0f, 1.0f, 0.0f));
@@ -139,8 +262,20 @@ public:
 
     glm::vec3 GetPosition() const { return currentPosition; }
     void SetPosition(const glm::vec3& pos) { currentPosition = pos; }
+    AnimatedModel& GetModel() { return *enemyModel; }
+
+    // Beyond the given distance the enemy skips ozz sampling and reads its pose from the baked texture
+    void SetBakedAnimation(std::shared_ptr<BakedAnimation> baked, float distance)
+    {
+        bakedAnimation = std::move(baked);
+        bakedAnimationDistance = distance;
+    }
 
 private:
+    // Custom packets submitted to the render queue
+    static constexpr uint32_t MODEL_PART = 0;
+    static constexpr uint32_t IMPOSTOR_PART = 1;
+
     std::unique_ptr<AnimatedModel> enemyModel;
     glm::vec3 initialPosition;
     float initialAngleY;
@@ -148,7 +283,22 @@ private:
     glm::vec3 currentPosition;
     glm::quat currentRotation;
     glm::mat4 modelMatrix;
-    std::unique_ptr<PlaneModel> blobShadow;
+    std::shared_ptr<const PlaneModel> blobShadow;
+    std::shared_ptr<BakedAnimation> bakedAnimation;
+    std::unique_ptr<SkinningCache> skinningCache;
+    std::shared_ptr<ImpostorAtlas> impostors;
+    float impostorDistance = 0.0f;
+    float impostorFadeBand = 1.0f;
+    float impostorBlend = 0.0f;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float bakedAnimationDistance = 0.0f;
+    bool bakedPlayback = false;
+    AnimationLOD animationLOD;
+    LodSelector meshLOD;
+    float animationEvictAfter = 0.0f;
+    float poseAge = std::numeric_limits<float>::max(); // Seconds since the pose was last evaluated
+    glm::vec3 boundsCenter;
+    float boundsRadius;
     EnemyState currentState;
     ma_sound* sound = nullptr;
     std::vector<glm::vec3> currentPath;
@@ -157,6 +307,60 @@ private:
     float nextIdleSoundTimer = 0.0f;
     float footstepTimer = 0.0f;
 
+    static ModelData loadModelData(const std::string& modelPath, const AnimationCompression& compression)
+    {
+        ModelData data;
+        ModelLoader::GetInstance().Load(modelPath, data, compression);
+        return data;
+    }
+
+    void setBoneTransformations(const Shader& shader) const
+    {
+        if (bakedPlayback)
+            bakedAnimation->SetBoneTransformations(shader, enemyModel->GetCurrentAnimation(), enemyModel->GetAnimationTime());
+        else
+            enemyModel->SetBoneTransformations(shader);
+    }
+
+    float poseUpdateInterval(float distToPlayer) const
+    {
+        if (animationLOD.MinUpdateRate <= 0.0f || distToPlayer <= animationLOD.FullRateDistance)
+            return 0.0f;
+
+        float range = std::max(animationLOD.MinRateDistance - animationLOD.FullRateDistance, 0.001f);
+        float t = std::min((distToPlayer - animationLOD.FullRateDistance) / range, 1.0f);
+        return t / animationLOD.MinUpdateRate;
+    }
+
+    // Height of the bounding sphere on screen, as a fraction of the view height
+    float projectedSize(const FPSCamera& camera) const
+    {
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(boundsCenter, 1.0f));
+        float radius = boundsRadius * std::max(scaleFactor.x, std::max(scaleFactor.y, scaleFactor.z));
+        float distance = glm::distance(center, camera.Position);
+        if (distance <= radius)
+            return 1.0f;
+
+        return radius / (distance * std::tan(glm::radians(camera.FOV) * 0.5f));
+    }
+
+    // Bounding sphere against the view cone, generous enough to never pop at the screen edges
+    bool isInView(const FPSCamera& camera) const
+    {
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(boundsCenter, 1.0f));
+        float radius = boundsRadius * std::max(scaleFactor.x, std::max(scaleFactor.y, scaleFactor.z));
+
+        glm::vec3 toCenter = center - camera.Position;
+        float distance = glm::length(toCenter);
+        if (distance <= radius)
+            return true;
+
+        float tanHalfFOV = std::tan(glm::radians(camera.FOV) * 0.5f);
+        float halfDiagonal = std::atan(tanHalfFOV * std::sqrt(1.0f + camera.AspectRatio * camera.AspectRatio));
+        float angle = std::acos(glm::clamp(glm::dot(toCenter / distance, camera.Front), -1.0f, 1.0f));
+        return angle <= halfDiagonal + std::asin(radius / distance);
+    }
+
     void updateStateTransitions(float distToPlayer)
     {
         switch (currentState)
@@ -2,10 +2,18 @@
 
 #include "shader.hpp"
 
+#include <cstdint>
+
+class RenderQueue;
+
 class Entity
 {
 public:
     bool AlwaysOnTop = false;
 
-    virtual void Draw(const Shader& shader) const = 0;
-};
\ No newline at end of file
+    // Adds the draws of the entity to the frame's render queue
+    virtual void Submit(RenderQueue& queue) const = 0;
+
+    // Draws one of the custom packets the entity submitted, see DrawPacket
+    virtual void DrawCustom(const Shader& /* shader */, uint32_t /* part */) const {}
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Counts the fragments that pass the depth test between Begin() and End(), with GL_SAMPLES_PASSED queries.
+// A frame's count is read back LATENCY frames later, and only once the GPU has it, so reading never stalls:
+// GetCount() is the last count that came back.
+class FragmentCounter
+{
+public:
+    static constexpr size_t LATENCY = 3; // Queries in flight
+
+    FragmentCounter()
+    {
+        glGenQueries(static_cast<GLsizei>(LATENCY), queries.data());
+    }
+
+    ~FragmentCounter()
+    {
+        glDeleteQueries(static_cast<GLsizei>(LATENCY), queries.data());
+    }
+
+    FragmentCounter(const FragmentCounter&) = delete;
+    FragmentCounter& operator=(const FragmentCounter&) = delete;
+
+    // Reuses the oldest query, collecting its count first; a frame whose query is still in flight is not counted
+    void Begin()
+    {
+        if (pending[next])
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(queries[next], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &samples);
+            count = samples;
+            pending[next] = false;
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, queries[next]);
+        counting = true;
+    }
+
+    void End()
+    {
+        if (!counting)
+            return;
+        glEndQuery(GL_SAMPLES_PASSED);
+        pending[next] = true;
+        next = (next + 1) % LATENCY;
+        counting = false;
+    }
+
+    uint64_t GetCount() const { return count; }
+
+private:
+    std::array<GLuint, LATENCY> queries{};
+    std::array<bool, LATENCY> pending{};
+    size_t next = 0;
+    bool counting = false;
+    uint64_t count = 0;
+};
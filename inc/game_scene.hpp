@@ -1,13 +1,26 @@
 #pragma once
 
+#include "asset_pipeline.hpp"
+#include "baked_animation.hpp"
 #include "enemy.hpp"
 #include "entity.hpp"
+#include "impostor_atlas.hpp"
 #include "item.hpp"
 #include "level.hpp"
+#include "model_loader.hpp"
 #include "object.hpp"
+#include "plane_model.hpp"
 #include "random_generator.hpp"
+#include "render_queue.hpp"
 #include "settings.hpp"
-#include "texture_2D.hpp"
+#include "texture_cache.hpp"
+
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 class GameScene
 {
@@ -15,19 +28,84 @@ public:
     GameScene(const SettingsData& settings)
         : settings(settings)
     {
-        Texture2D levelTexture(settings.LevelTextureFile);
-        level = new Level(settings.LevelMapFile, levelTexture);
+        renderQueue.SetCullDistance(settings.DrawDistance);
+    }
 
-        for (const auto& position : level->GetEnemyPositions())
-            AddEnemy(position);
+    ~GameScene()
+    {
+        delete level;
+    }
+
+    // Streams the level, enemies and lights in: decodes and imports run on the worker threads,
+    // the GL uploads are spread over the next frames by AssetPipeline::ProcessUploads()
+    AssetTask Load()
+    {
+        AssetPipeline& pipeline = AssetPipeline::GetInstance();
+        PendingLoad pending(pendingLoads);
+        loadStarted = true;
+
+        co_await pipeline.ResumeOnWorker();
+        ImageData levelMap(settings.LevelMapFile, 1);
+        ImageData levelImage(settings.LevelTextureFile);
+        auto loaded = std::make_unique<Level>(std::move(levelMap));
+        if (settings.BakedLevelLighting)
+        {
+            LightBaker baker(settings.AttenuationConstant, settings.AttenuationLinear, settings.AttenuationQuadratic,
+                             settings.AttenuationCutoff, settings.AmbientColor * settings.AmbientIntensity);
+            loaded->BakeLighting(baker);
+        }
+
+        co_await pipeline.ResumeOnGLThread();
+        loaded->Upload(TextureCache::GetInstance().Acquire(settings.LevelTextureFile, levelImage));
+        level = loaded.release();
+        refreshRenderList();
+
+        loadEnemies(level->GetEnemyPositions());
 
         for (const auto& position : level->GetLightPositions())
-            AddObject(position);
+            loadObject(position);
     }
 
-    ~GameScene()
+    AssetTask LoadItem(std::string modelPath, std::string texturePath,
+         glm::vec3 posOffset, glm::vec3 rotOffset, glm::vec3 scaleFactor)
     {
-        delete level;
+        AssetPipeline& pipeline = AssetPipeline::GetInstance();
+        PendingLoad pending(pendingLoads);
+
+        co_await pipeline.ResumeOnWorker();
+        ModelData modelData;
+        ImageData texture;
+        bool loaded = false;
+        try
+        {
+            modelData = Model::Load(modelPath);
+            loaded = true;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+        if (!texturePath.empty())
+            texture = ImageData(texturePath);
+
+        co_await pipeline.ResumeOnGLThread();
+        if (loaded)
+        {
+            items.push_back(std::make_unique<Item>(std::move(modelData), texturePath, texture, posOffset, rotOffset, scaleFactor));
+            refreshRenderList();
+        }
+    }
+
+    // Everything started by Load() and LoadItem() is in
+    bool IsLoaded() const
+    {
+        return level && pendingLoads == 0;
+    }
+
+    // Load() ended without a level, e.g. the map or its texture could not be read
+    bool HasLoadFailed() const
+    {
+        return loadStarted && !level && pendingLoads == 0;
     }
 
     void Reset()
@@ -43,17 +121,56 @@ public:
         refreshRenderList();
     }
 
-    void AddEnemy(glm::vec3 position)
+    void AddEnemy(glm::vec3 position, const ModelData& modelData)
     {
         float angle = static_cast<float>(random.GetRandomInRange(0, 360));
         position.y = 0.0f;
-        enemies.push_back(std::make_unique<Enemy>(settings.EnemyModelFile, position, angle, glm::vec3(0.5f)));
+        enemies.push_back(std::make_unique<Enemy>(modelData, position, angle, glm::vec3(0.5f)));
+
+        if (!blobShadow)
+            blobShadow = std::make_shared<PlaneModel>("assets/blob_shadow.png");
+        enemies.back()->SetBlobShadow(blobShadow);
+
+        // "inertialization" samples one clip during state flips, "crossfade" blends two
+        if (settings.EnemyAnimationTransition == "inertialization")
+            enemies.back()->GetModel().SetTransitionMode(TransitionMode::INERTIALIZATION);
+
+        enemies.back()->SetAnimationEviction(settings.EnemyAnimationEvictAfter);
+        if (settings.EnemyAnimationEvictAfter > 0.0f && enemies.size() == 1 && !enemies.back()->GetModel().CanEvictAnimations())
+            std::cerr << "ERROR::GAME_SCENE: enemy.animationClips.evictAfter is ignored, the clips of "
+                      << settings.EnemyModelFile << " are not read from a baked model" << std::endl;
+
+        // Every enemy shares the same clips, so the pose texture and the impostors are baked once (see loadEnemies)
+        if (enemyBakedAnimation)
+            enemies.back()->SetBakedAnimation(enemyBakedAnimation, settings.EnemyBakedAnimationDistance);
+        if (enemyImpostors)
+            enemies.back()->SetImpostors(enemyImpostors, settings.EnemyImpostorDistance, settings.EnemyImpostorFadeBand);
+
+        if (settings.EnemyAnimationLOD)
+        {
+            AnimationLOD lod;
+            lod.FullRateDistance = settings.EnemyAnimationFullRateDistance;
+            lod.MinRateDistance = settings.EnemyAnimationMinRateDistance;
+            lod.MinUpdateRate = settings.EnemyAnimationMinUpdateRate;
+            lod.LeafJointDistance = settings.EnemyAnimationLeafJointDistance;
+            lod.CullOffscreen = settings.EnemyAnimationCullOffscreen;
+            enemies.back()->SetAnimationLOD(lod);
+        }
+
+        if (settings.MeshLOD)
+            enemies.back()->SetMeshLOD(settings.MeshLODScreenSize, settings.MeshLODHysteresis);
+
+        if (settings.TransformFeedbackSkinning)
+            enemies.back()->EnableSkinningCache();
+
         refreshRenderList();
     }
 
     void AddObject(glm::vec3 position)
     {
-        objects.push_back(std::make_unique<Object>(position));
+        if (!objectModel)
+            objectModel = std::make_shared<CubeModel>("assets/texture_05.png");
+        objects.push_back(std::make_unique<Object>(position, objectModel));
         refreshRenderList();
     }
 
@@ -62,13 +179,16 @@ public:
         return level->StartingPosition;
     }
 
-    void SetLights(Shader& shader)
+    void SetLights(LightClusters& lightClusters)
     {
-        level->SetLights(shader);
+        level->SetLights(lightClusters);
     }
 
     void Update(float deltaTime, FPSCamera& camera)
     {
+        if (!level)
+            return;
+
         handleCollisions(camera);
         for (auto& enemy : enemies)
             enemy->Update(deltaTime, camera, *level);
@@ -93,15 +213,22 @@ public:
         }
     }
 
-    void Draw(const Shader& shader)
+    // Skinning stage: runs before any pass so that every pass draws the enemies as static geometry
+    void Skin(const Shader& skinningShader)
     {
-        for (Entity* entity : renderList)
-        {
-            if (entity->AlwaysOnTop)
-                glClear(GL_DEPTH_BUFFER_BIT);
+        for (auto& enemy : enemies)
+            enemy->Skin(skinningShader);
+    }
 
-            entity->Draw(shader);
-        }
+    // Entities submit their draws, the queue sorts them by pass and state and merges what it can.
+    // With a depth shader the opaque draws get a depth pre-pass first.
+    void Draw(const Shader& shader, const glm::vec3& cameraPosition, const Shader* depthShader = nullptr,
+              const Shader* alphaTestShader = nullptr)
+    {
+        renderQueue.Begin(cameraPosition);
+        for (Entity* entity : renderList)
+            entity->Submit(renderQueue);
+        renderQueue.Flush(shader, depthShader, alphaTestShader);
     }
 
     void ToggleSounds(const bool pause)
@@ -111,19 +238,118 @@ public:
     }
 
 private:
-    Level* level;
+    Level* level = nullptr;
     std::vector<std::unique_ptr<Enemy>> enemies;
     std::vector<std::unique_ptr<Object>> objects;
     std::vector<std::unique_ptr<Item>> items;
     std::vector<Entity*> renderList;
+    RenderQueue renderQueue;
+    std::shared_ptr<PlaneModel> blobShadow;
+    std::shared_ptr<CubeModel> objectModel;
+    std::shared_ptr<BakedAnimation> enemyBakedAnimation;
+    std::shared_ptr<ImpostorAtlas> enemyImpostors;
     SettingsData settings;
     RandomGenerator& random = RandomGenerator::GetInstance();
+    std::atomic<int> pendingLoads = 0; // Loading tasks not finished yet
+    bool loadStarted = false;
+
+    // Counts a loading task for as long as its coroutine lives, so a task that throws is not waited on forever
+    struct PendingLoad
+    {
+        std::atomic<int>& count;
+
+        PendingLoad(std::atomic<int>& count) : count(count) { ++count; }
+        ~PendingLoad() { --count; }
+    };
+
+    // Every enemy uses the same model file: it is imported once and each enemy is instanced from it.
+    // The baked poses and impostor frames are sampled on the worker too, from a model without meshes sharing
+    // the clips; the GL continuations only upload, one enemy or impostor clip each so that they spread over frames.
+    AssetTask loadEnemies(std::vector<glm::vec3> positions)
+    {
+        AssetPipeline& pipeline = AssetPipeline::GetInstance();
+        PendingLoad pending(pendingLoads);
+
+        co_await pipeline.ResumeOnWorker();
+        ModelData modelData;
+        BakedPoses bakedPoses;
+        ImpostorPoses impostorPoses;
+        bool loaded = false;
+        try
+        {
+            loaded = ModelLoader::GetInstance().Load(settings.EnemyModelFile, modelData, enemyAnimationCompression());
+            if (loaded && settings.EnemyAnimationPrefetch)
+                ModelLoader::BuildClip(modelData, Enemy::INITIAL_ANIMATION);
+
+            if (loaded && (settings.EnemyBakedAnimation || settings.EnemyImpostors))
+            {
+                AnimatedModel sampler;
+                ModelLoader::InstantiateAnimation(modelData, sampler);
+                if (settings.EnemyBakedAnimation)
+                    bakedPoses = BakedAnimation::Sample(sampler, settings.EnemyBakedAnimationSampleRate);
+                if (settings.EnemyImpostors)
+                    impostorPoses = ImpostorAtlas::Sample(sampler, settings.EnemyImpostorFramesPerClip);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+
+        co_await pipeline.ResumeOnGLThread();
+        if (!loaded)
+            co_return;
+        if (settings.EnemyBakedAnimation)
+            enemyBakedAnimation = std::make_shared<BakedAnimation>(bakedPoses);
+
+        for (const auto& position : positions)
+        {
+            co_await pipeline.ResumeOnGLThread();
+            AddEnemy(position, modelData);
+        }
+
+        // The enemies draw the impostors once every clip is captured
+        if (settings.EnemyImpostors && !enemies.empty())
+        {
+            // The capture program is only needed while baking
+            Shader bakeShader(settings.ForwardShadingVertexShaderFile, settings.EnemyImpostorFragmentShaderFile, "",
+                              ForwardShadingDefines(settings));
+            auto atlas = std::make_shared<ImpostorAtlas>(enemies.front()->GetModel(), std::move(impostorPoses),
+                                                         settings.EnemyImpostorAngles, settings.EnemyImpostorCellSize);
+            do
+            {
+                co_await pipeline.ResumeOnGLThread();
+            } while (!atlas->CaptureClip(enemies.front()->GetModel(), bakeShader));
+
+            enemyImpostors = atlas;
+            for (auto& enemy : enemies)
+                enemy->SetImpostors(enemyImpostors, settings.EnemyImpostorDistance, settings.EnemyImpostorFadeBand);
+        }
+    }
+
+    AssetTask loadObject(glm::vec3 position)
+    {
+        AssetPipeline& pipeline = AssetPipeline::GetInstance();
+        PendingLoad pending(pendingLoads);
+
+        co_await pipeline.ResumeOnGLThread();
+        AddObject(position);
+    }
+
+    AnimationCompression enemyAnimationCompression() const
+    {
+        AnimationCompression compression;
+        compression.Tolerance = settings.EnemyAnimationTolerance;
+        compression.Distance = settings.EnemyAnimationToleranceDistance;
+        return compression;
+    }
 
     void refreshRenderList()
     {
         renderList.clear();
 
-        renderList.push_back(level);
+        if (level)
+            renderList.push_back(level);
 
         for (auto& enemy : enemies)
             renderList.push_back(enemy.get());
@@ -133,12 +359,6 @@ private:
 
         for (auto& item : items)
             renderList.push_back(item.get());
-
-        // Move AlwaysOnTop entities to the end of the vector
-        std::stable_partition(renderList.begin(), renderList.end(), [](Entity* entity)
-        {
-            return !entity->AlwaysOnTop;
-        });
     }
 
     void handleCollisions(FPSCamera& camera)
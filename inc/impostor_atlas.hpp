@@ -0,0 +1,291 @@
+#pragma once
+
+#include "animated_model.hpp"
+#include "material.hpp"
+#include "render_state.hpp"
+#include "shader.hpp"
+#include "uniform_buffer.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+constexpr int DEFAULT_IMPOSTOR_ANGLES = 8;
+constexpr int DEFAULT_IMPOSTOR_FRAMES_PER_CLIP = 8;
+constexpr int DEFAULT_IMPOSTOR_CELL_SIZE = 64;
+
+// Poses captured by an ImpostorAtlas, framesPerClip per clip, sampled ahead of time on the CPU
+struct ImpostorPoses
+{
+    int numClips = 0;
+    int framesPerClip = DEFAULT_IMPOSTOR_FRAMES_PER_CLIP;
+    std::vector<std::vector<glm::mat4>> frames; // Clip after clip, empty when the sampling failed
+};
+
+// Sprite atlas of an animated model: every clip is captured at a few frames from N yaw angles
+// into an offscreen framebuffer, so far instances can be drawn as a single camera-facing quad.
+// The poses are sampled by Sample(), e.g. on a worker thread, and captured a clip at a time by CaptureClip().
+class ImpostorAtlas
+{
+public:
+    // Sets up the atlas for the given poses, the model only gives the bounds
+    ImpostorAtlas(const AnimatedModel& model, ImpostorPoses poses,
+                  int numAngles = DEFAULT_IMPOSTOR_ANGLES,
+                  int cellSize = DEFAULT_IMPOSTOR_CELL_SIZE)
+        : numAngles(numAngles), framesPerClip(poses.framesPerClip), cellSize(cellSize), poses(std::move(poses))
+    {
+        glm::vec3 boundsMin, boundsMax;
+        model.GetBounds(boundsMin, boundsMax);
+        center = (boundsMin + boundsMax) * 0.5f;
+        radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+        setupQuad();
+        setupAtlas();
+    }
+
+    ~ImpostorAtlas()
+    {
+        RenderState& state = RenderState::GetInstance();
+        state.DeleteTexture(texture);
+        state.DeleteVertexArray(VAO);
+        glDeleteBuffers(1, &VBO);
+        releaseCapture();
+    }
+
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    // Samples framesPerClip poses of every clip. No GL: the model can be one without meshes,
+    // see ModelLoader::InstantiateAnimation().
+    static ImpostorPoses Sample(AnimatedModel& model, int framesPerClip = DEFAULT_IMPOSTOR_FRAMES_PER_CLIP)
+    {
+        ImpostorPoses poses;
+        poses.numClips = static_cast<int>(model.GetNumAnimations());
+        poses.framesPerClip = framesPerClip;
+        poses.frames.resize(static_cast<size_t>(poses.numClips) * framesPerClip);
+        for (int clip = 0; clip < poses.numClips; ++clip)
+        {
+            for (int frame = 0; frame < framesPerClip; ++frame)
+            {
+                float ratio = static_cast<float>(frame) / static_cast<float>(framesPerClip);
+                std::vector<glm::mat4>& pose = poses.frames[clip * framesPerClip + frame];
+                if (!model.SampleClipPose(clip, ratio, pose))
+                    pose.clear();
+            }
+        }
+        return poses;
+    }
+
+    // Renders the next clip's cells with the mesh of the model; true once every clip is in the atlas.
+    // One clip per call, so that the capture can be spread over frames.
+    bool CaptureClip(AnimatedModel& model, const Shader& bakeShader)
+    {
+        if (nextClip < poses.numClips)
+            captureClip(model, bakeShader, nextClip++);
+        if (nextClip < poses.numClips)
+            return false;
+
+        if (captureFBO != 0)
+        {
+            releaseCapture();
+            poses.frames.clear();
+            std::cout << "Baked impostor atlas: " << poses.numClips * framesPerClip * numAngles << " sprites, "
+                      << columns * cellSize << "x" << rows * cellSize << std::endl;
+        }
+        return true;
+    }
+
+    // Draws the cell matching the clip, frame and view angle on a quad turned towards the camera
+    void Draw(const Shader& shader, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+              const glm::vec3& cameraPosition, unsigned int animIndex, float time, float duration, float opacity) const
+    {
+        if (texture == 0 || nextClip < poses.numClips) return;
+
+        glm::vec3 worldCenter = position + rotation * (center * scale);
+        glm::vec3 toCamera = cameraPosition - worldCenter;
+        toCamera.y = 0.0f;
+
+        // View angle in model space picks the captured direction
+        glm::vec3 localToCamera = glm::inverse(rotation) * toCamera;
+        float viewAngle = std::atan2(localToCamera.x, localToCamera.z);
+        if (viewAngle < 0.0f) viewAngle += glm::two_pi<float>();
+        int angle = static_cast<int>(std::round(viewAngle / glm::two_pi<float>() * numAngles)) % numAngles;
+
+        int frame = static_cast<int>(time / duration * framesPerClip) % framesPerClip;
+        int cell = (static_cast<int>(animIndex) * framesPerClip + frame) * numAngles + angle;
+        int column = cell % columns;
+        int row = cell / columns;
+
+        // Cylindrical billboard: yaw only, so the sprite stays upright like the captures
+        float yaw = std::atan2(toCamera.x, toCamera.z);
+        glm::mat4 R = glm::rotate(glm::mat4(1.0f), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), worldCenter) * R *
+                                glm::scale(glm::mat4(1.0f), glm::vec3(2.0f * radius * scale.x));
+
+        shader.Use();
+        shader.SetBool("animated", false);
+        shader.SetMat4("modelMatrix", modelMatrix);
+        shader.SetMat3("normalMatrix", glm::mat3(R));
+        shader.SetVec4("texCoordsTransform", glm::vec4(1.0f / columns, 1.0f / rows,
+                                                       static_cast<float>(column) / columns,
+                                                       static_cast<float>(row) / rows));
+        shader.SetFloat("opacity", opacity);
+        shader.SetBool("materialArrays", false);
+
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(0, GL_TEXTURE_2D, texture);
+        state.BindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // Restore the defaults for the following draws
+        shader.SetVec4("texCoordsTransform", glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+        shader.SetFloat("opacity", 1.0f);
+    }
+
+private:
+    GLuint texture = 0;
+    GLuint VAO, VBO;
+    int numAngles, framesPerClip, cellSize;
+    int columns = 1, rows = 1;
+    glm::vec3 center;
+    float radius;
+    ImpostorPoses poses;
+    int nextClip = 0;
+    GLuint captureFBO = 0, captureDepth = 0; // Only while capturing
+
+    void setupQuad()
+    {
+        // Unit quad facing +Z: positions, normals, texture coordinates
+        const GLfloat vertices[] = {
+            -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+             0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+             0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+             0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+            -0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
+            -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f
+        };
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void*)(6 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        state.BindVertexArray(0);
+    }
+
+    // Atlas texture and the framebuffer the clips are captured into, cleared to transparent
+    void setupAtlas()
+    {
+        int numCells = poses.numClips * framesPerClip * numAngles;
+        if (numCells == 0) return;
+
+        columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(numCells))));
+        rows = (numCells + columns - 1) / columns;
+        int width = columns * cellSize;
+        int height = rows * cellSize;
+
+        RenderState& state = RenderState::GetInstance();
+        glGenTextures(1, &texture);
+        state.BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state.BindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &captureFBO);
+        glGenRenderbuffers(1, &captureDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, captureDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        state.BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::IMPOSTOR_ATLAS: Failed to initialize FBO" << std::endl;
+
+        state.DepthMask(true);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void releaseCapture()
+    {
+        RenderState::GetInstance().DeleteFramebuffer(captureFBO);
+        if (captureDepth != 0) glDeleteRenderbuffers(1, &captureDepth);
+        captureDepth = 0;
+    }
+
+    void captureClip(AnimatedModel& model, const Shader& bakeShader, int clip)
+    {
+        if (captureFBO == 0) return;
+
+        // Remember the state we are about to change
+        RenderState& state = RenderState::GetInstance();
+        std::array<GLint, 4> previousViewport = state.GetViewport();
+        bool depthTestEnabled = state.IsEnabled(GL_DEPTH_TEST);
+        GLuint previousFrameBuffer = state.GetUniformBuffer(FRAME_UNIFORMS_BINDING);
+
+        state.BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        state.Enable(GL_DEPTH_TEST);
+
+        // Orthographic capture around the bind pose bounding sphere, with its own frame block
+        UniformBuffer<FrameUniforms> captureFrame(FRAME_UNIFORMS_BINDING);
+        FrameUniforms captureUniforms{};
+        captureUniforms.projectionMatrix = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+
+        MaterialLibrary::SetupSamplers(bakeShader);
+        bakeShader.SetMat4("modelMatrix", glm::mat4(1.0f));
+        bakeShader.SetMat3("normalMatrix", glm::mat3(1.0f));
+
+        for (int frame = 0; frame < framesPerClip; ++frame)
+        {
+            const std::vector<glm::mat4>& pose = poses.frames[clip * framesPerClip + frame];
+            if (pose.empty())
+                continue;
+            model.SetBoneTransformations(bakeShader, pose);
+
+            for (int angle = 0; angle < numAngles; ++angle)
+            {
+                float theta = glm::two_pi<float>() * angle / numAngles;
+                glm::vec3 direction = glm::vec3(std::sin(theta), 0.0f, std::cos(theta));
+                captureUniforms.viewMatrix = glm::lookAt(center + direction * radius, center, glm::vec3(0.0f, 1.0f, 0.0f));
+                captureUniforms.cameraPos = center + direction * radius;
+                captureFrame.Upload(captureUniforms);
+
+                int cell = (clip * framesPerClip + frame) * numAngles + angle;
+                state.Viewport((cell % columns) * cellSize, (cell / columns) * cellSize, cellSize, cellSize);
+                model.Draw(bakeShader);
+            }
+        }
+
+        // Restore the state
+        state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (previousViewport[2] >= 0)
+            state.Viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        state.BindUniformBuffer(FRAME_UNIFORMS_BINDING, previousFrameBuffer);
+        if (!depthTestEnabled)
+            state.Disable(GL_DEPTH_TEST);
+    }
+};
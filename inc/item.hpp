@@ -3,6 +3,7 @@
 #include "entity.hpp"
 #include "fps_camera.hpp"
 #include "model.hpp"
+#include "render_queue.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
@@ -25,18 +26,28 @@ public:
         AlwaysOnTop = true;
     }
 
+    // Uploads a model and texture loaded ahead of time, an empty texture path keeps the model's own
+    Item(ModelData&& modelData, const std::string& texturePath, const ImageData& texture,
+         const glm::vec3 posOffset, const glm::vec3 rotOffset, const glm::vec3 scaleFactor)
+         : positionOffset(posOffset), rotationOffset(rotOffset), scaleFactor(scaleFactor)
+    {
+        itemModel = std::make_unique<Model>(std::move(modelData));
+        if (!texturePath.empty())
+            itemModel->TextureOverride(texturePath, texture);
+
+        AlwaysOnTop = true;
+    }
+
     void Update(const float deltaTime, const FPSCamera& camera)
     {
         updateModelMatrix(camera);
     }
 
-    void Draw(const Shader& shader) const override
+    void Submit(RenderQueue& queue) const override
     {
-        shader.Use();
-        shader.SetMat4("modelMatrix", modelMatrix);
-        shader.SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(modelMatrix))));
-
-        itemModel->Draw(shader);
+        RenderPass pass = AlwaysOnTop ? RenderPass::Overlay : RenderPass::Opaque;
+        for (const auto& mesh : itemModel->GetMeshes())
+            queue.SubmitMesh(pass, mesh, modelMatrix);
     }
 
 private:
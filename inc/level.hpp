@@ -1,24 +1,26 @@
 #pragma once
 
 #include "entity.hpp"
+#include "light_baker.hpp"
+#include "light_clusters.hpp"
 #include "random_generator.hpp"
+#include "render_queue.hpp"
+#include "render_state.hpp"
 #include "shader.hpp"
 #include "texture_2D.hpp"
+#include "texture_cache.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <iostream>
 #include <queue>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-struct Light
-{
-    glm::vec3 position;
-    glm::vec3 color;
-};
-
 enum TileKey
 {
     COLOR_FLOOR  = 255,
@@ -56,39 +58,104 @@ struct PathNode
 constexpr float DEFAULT_TILE_FRACTION = 128.0f / 512.0f; // tile size / tilemap size
 constexpr float DEFAULT_TILE_SIZE = 3.0f;
 constexpr glm::vec3 DEFAULT_LIGHT_COLOR = glm::vec3(0.7f, 0.0f, 0.0f);
-constexpr size_t MAX_LIGHTS = 32;
+
+// Unit of the baked lightmap, after the light cluster units (see light_clusters.hpp)
+constexpr GLuint LIGHTMAP_TEXTURE_UNIT = 10;
+// Vertex attribute of the lightmap coordinates (see default.vs)
+constexpr GLuint LIGHTMAP_COORDS_LOCATION = 10;
 
 class Level : public Entity
 {
 public:
     glm::vec3 StartingPosition;
 
-    Level(const std::string& mapPath, Texture2D texture)
-        : texture(texture)
+    // CPU only, so it can run on a worker thread: the map is decoded with one channel, the tile keys.
+    // Nothing can be drawn until Upload() has run on the GL thread.
+    explicit Level(ImageData map)
+        : levelMap(std::move(map))
     {
-        loadLevel(mapPath);
-        setupBuffers();
+        loadLevel();
+        placeLightmapCells();
     }
 
     ~Level()
     {
-        stbi_image_free(levelData);
-        if (VAO != 0) glDeleteVertexArrays(1, &VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.DeleteVertexArray(VAO);
+        state.DeleteTexture(lightmapTexture);
         if (VBO != 0) glDeleteBuffers(1, &VBO);
     }
 
-    void Draw(const Shader& shader) const override
+    // The level lights never move: their contribution is baked into a lightmap, walls blocking it, and the
+    // level is then drawn with the lightmap instead of the light clusters. CPU only, meant for a worker thread
+    // before Upload(); the texels are kept until then.
+    void BakeLighting(const LightBaker& baker)
+    {
+        OcclusionGrid occluders;
+        occluders.Width = levelWidth;
+        occluders.Depth = levelDepth;
+        occluders.TileSize = quadSize;
+        occluders.Blocking.resize(tiles.size());
+        for (size_t i = 0; i < tiles.size(); ++i)
+            occluders.Blocking[i] = tiles[i].key == COLOR_WALL;
+
+        auto start = std::chrono::steady_clock::now();
+        lightmap = baker.Bake(lightmapQuads, lights, occluders);
+        auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "Lightmap " << lightmap.Width << "x" << lightmap.Height << ": " << lightmapQuads.size() << " quads, "
+                  << lights.size() << " lights, baked in " << milliseconds << " ms" << std::endl;
+    }
+
+    // GL thread: creates the vertex buffer and, if BakeLighting() ran, the lightmap texture
+    void Upload(TextureHandle levelTexture)
+    {
+        texture = std::move(levelTexture);
+        setupBuffers();
+        if (lightmap.Texels.empty())
+            return;
+
+        RenderState& state = RenderState::GetInstance();
+        glGenTextures(1, &lightmapTexture);
+        state.BindTexture(GL_TEXTURE_2D, lightmapTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, lightmap.Width, lightmap.Height, 0, GL_RGB, GL_FLOAT, lightmap.Texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        state.BindTexture(GL_TEXTURE_2D, 0);
+        lightmap = Lightmap();
+    }
+
+    // The level is not a mesh: the queue hands it back as a custom packet
+    void Submit(RenderQueue& queue) const override
+    {
+        queue.SubmitCustom(RenderPass::Opaque, *this, 0, glm::vec3(0.0f));
+    }
+
+    void DrawCustom(const Shader& shader, uint32_t /* part */) const override
+    {
+        Draw(shader);
+    }
+
+    void Draw(const Shader& shader) const
     {
         shader.Use();
+        shader.SetBool("animated", false);
         shader.SetMat4("modelMatrix", glm::mat4(1.0f));
         shader.SetMat3("normalMatrix", glm::mat3(1.0f));
+        shader.SetBool("materialArrays", false);
+        shader.SetBool("bakedLighting", lightmapTexture != 0);
 
-        glActiveTexture(GL_TEXTURE0);
+        RenderState& state = RenderState::GetInstance();
+        state.ActiveTexture(0);
         texture.Bind();
+        if (lightmapTexture != 0)
+            state.BindTexture(LIGHTMAP_TEXTURE_UNIT, GL_TEXTURE_2D, lightmapTexture);
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 8));
-        glBindVertexArray(0);
+        state.BindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / VERTEX_SIZE));
+        shader.SetBool("bakedLighting", false);
     }
 
     Tile& GetTile(const glm::vec3& position)
@@ -121,15 +188,9 @@ public:
         return neighbors;
     }
 
-    void SetLights(const Shader& shader)
+    void SetLights(LightClusters& lightClusters) const
     {
-        shader.Use();
-        for (size_t i = 0; i < numLights(); ++i)
-        {
-            shader.SetVec3("lights[" + std::to_string(i) + "].position", lights[i].position);
-            shader.SetVec3("lights[" + std::to_string(i) + "].color", lights[i].color);
-        }
-        shader.SetInt("numLights", numLights());
+        lightClusters.SetLights(lights);
     }
 
     std::vector<glm::vec3> GetLightPositions() const
@@ -223,15 +284,20 @@ public:
     }
 
 private:
+    static constexpr size_t VERTEX_SIZE = 10; // Position, normal, texture and lightmap coordinates
+
     const float tileFraction = DEFAULT_TILE_FRACTION;
     const float quadSize = DEFAULT_TILE_SIZE;
 
     int levelWidth, levelDepth;
-    unsigned char* levelData;
-    GLuint VAO, VBO;
-    Texture2D texture;
+    ImageData levelMap;
+    GLuint VAO = 0, VBO = 0;
+    TextureHandle texture;
     std::vector<Tile> tiles;
     std::vector<GLfloat> vertices;
+    std::vector<LightmapQuad> lightmapQuads; // In vertex order, six vertices each
+    Lightmap lightmap; // Baked texels waiting for Upload()
+    GLuint lightmapTexture = 0;
     std::vector<Light> lights;
     std::vector<glm::vec3> lightPositions;
     std::vector<glm::vec3> enemyPositions;
@@ -243,23 +309,27 @@ private:
     {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindVertexArray(VAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
 
         // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void *)0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (void *)0);
         glEnableVertexAttribArray(0);
         // normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void *)(3 * sizeof(GLfloat)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (void *)(3 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
         // texture coord attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void *)(6 * sizeof(GLfloat)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (void *)(6 * sizeof(GLfloat)));
         glEnableVertexAttribArray(2);
+        // lightmap coord attribute
+        glVertexAttribPointer(LIGHTMAP_COORDS_LOCATION, 2, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (void *)(8 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(LIGHTMAP_COORDS_LOCATION);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        state.BindVertexArray(0);
     }
 
     void addBlock(int x, int z)
@@ -299,10 +369,10 @@ private:
         glm::vec3 nD = {  0.0f, -1.0f,  0.0f }; // Down
 
         // Determine if the neighboring tiles should be considered for wall generation
-        bool hasFloorFront = (z - 1 >= 0) && (levelData[(z - 1) * levelWidth + x] == COLOR_FLOOR);
-        bool hasFloorBack  = (z + 1 < levelDepth) && (levelData[(z + 1) * levelWidth + x] == COLOR_FLOOR);
-        bool hasFloorLeft  = (x - 1 >= 0) && (levelData[z  * levelWidth + (x - 1)] == COLOR_FLOOR);
-        bool hasFloorRight = (x + 1 < levelWidth) && (levelData[z  * levelWidth + (x + 1)] == COLOR_FLOOR);
+        bool hasFloorFront = (z - 1 >= 0) && (levelMap.Pixels[(z - 1) * levelWidth + x] == COLOR_FLOOR);
+        bool hasFloorBack  = (z + 1 < levelDepth) && (levelMap.Pixels[(z + 1) * levelWidth + x] == COLOR_FLOOR);
+        bool hasFloorLeft  = (x - 1 >= 0) && (levelMap.Pixels[z  * levelWidth + (x - 1)] == COLOR_FLOOR);
+        bool hasFloorRight = (x + 1 < levelWidth) && (levelMap.Pixels[z  * levelWidth + (x + 1)] == COLOR_FLOOR);
 
         // Backward wall
         if (hasFloorFront)
@@ -320,13 +390,8 @@ private:
 
     void addLight(const glm::vec3& position, const glm::vec3& color)
     {
-        if (lights.size() < MAX_LIGHTS)
-        {
-            lights.push_back({ position, color });
-            lightPositions.push_back({ position });
-        }
-        else
-            std::cerr << "Warning: Maximum number of lights exceeded!" << std::endl;
+        lights.push_back({ position, color });
+        lightPositions.push_back({ position });
     }
 
     void addEnemy(const glm::vec3& position)
@@ -334,11 +399,6 @@ private:
         enemyPositions.push_back({ position });
     }
 
-    int numLights() const
-    {
-        return static_cast<int>(lights.size());
-    }
-
     std::vector<glm::vec3> retracePath(std::unordered_map<int, int>& parent, int startID, int endID)
     {
         std::vector<glm::vec3> path;
@@ -355,15 +415,14 @@ private:
         return path;
     }
 
-    void loadLevel(const std::string& path)
+    void loadLevel()
     {
-        // Load level data from the image
-        int channels;
-        levelData = stbi_load(path.c_str(), &levelWidth, &levelDepth, &channels, 1);
-        if (!levelData)
+        if (!levelMap.Pixels || levelMap.Channels != 1)
         {
-            throw std::runtime_error("Failed to load level: " + path);
+            throw std::runtime_error("Failed to load level: no single-channel map");
         }
+        levelWidth = levelMap.Width;
+        levelDepth = levelMap.Height;
 
         tiles.resize(levelWidth * levelDepth);
 
@@ -373,7 +432,7 @@ private:
             for (int x = 0; x < levelWidth; ++x)
             {
                 Tile tile;
-                tile.key = levelData[z * levelWidth + x];
+                tile.key = levelMap.Pixels[z * levelWidth + x];
                 tile.aabb = { { x * quadSize, 0.0f, z * quadSize },                   // min
                               { (x + 1) * quadSize, quadSize, (z + 1) * quadSize } }; // max
                 tiles[z * levelWidth + x] = tile;
@@ -424,15 +483,29 @@ private:
         float v1 = v0 + tileFraction;     // Top edge of the tile
 
         std::vector<GLfloat> newVertices = {
-            // Vertex positions, normals, and texture coordinates
-            ver0.x, ver0.y, ver0.z, normal.x, normal.y, normal.z, u0, v1, // 0, 1
-            ver1.x, ver1.y, ver1.z, normal.x, normal.y, normal.z, u1, v1, // 1, 1
-            ver2.x, ver2.y, ver2.z, normal.x, normal.y, normal.z, u1, v0, // 1, 0
-            ver2.x, ver2.y, ver2.z, normal.x, normal.y, normal.z, u1, v0, // 1, 0
-            ver3.x, ver3.y, ver3.z, normal.x, normal.y, normal.z, u0, v0, // 0, 0
-            ver0.x, ver0.y, ver0.z, normal.x, normal.y, normal.z, u0, v1  // 0, 1
+            // Vertex positions, normals, texture coordinates, and the quad corner until placeLightmapCells()
+            ver0.x, ver0.y, ver0.z, normal.x, normal.y, normal.z, u0, v1, 0.0f, 0.0f, // 0, 1
+            ver1.x, ver1.y, ver1.z, normal.x, normal.y, normal.z, u1, v1, 1.0f, 0.0f, // 1, 1
+            ver2.x, ver2.y, ver2.z, normal.x, normal.y, normal.z, u1, v0, 1.0f, 1.0f, // 1, 0
+            ver2.x, ver2.y, ver2.z, normal.x, normal.y, normal.z, u1, v0, 1.0f, 1.0f, // 1, 0
+            ver3.x, ver3.y, ver3.z, normal.x, normal.y, normal.z, u0, v0, 0.0f, 1.0f, // 0, 0
+            ver0.x, ver0.y, ver0.z, normal.x, normal.y, normal.z, u0, v1, 0.0f, 0.0f  // 0, 1
         };
 
         vertices.insert(vertices.end(), newVertices.begin(), newVertices.end());
+        lightmapQuads.push_back({ { ver0, ver1, ver2, ver3 }, normal });
+    }
+
+    // Turns the quad corners into lightmap coordinates, each quad getting its own cell
+    void placeLightmapCells()
+    {
+        Lightmap layout = LightBaker::Layout(lightmapQuads.size());
+        for (size_t vertex = 0; vertex * VERTEX_SIZE < vertices.size(); ++vertex)
+        {
+            GLfloat* coords = &vertices[vertex * VERTEX_SIZE + 8];
+            glm::vec2 lightmapCoords = LightBaker::Coords(layout, vertex / 6, glm::vec2(coords[0], coords[1]));
+            coords[0] = lightmapCoords.x;
+            coords[1] = lightmapCoords.y;
+        }
     }
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "light_clusters.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+// A quad of static geometry, baked into a square cell of the lightmap
+struct LightmapQuad
+{
+    std::array<glm::vec3, 4> Corners; // Winding order: corners 1 and 3 are next to corner 0
+    glm::vec3 Normal;
+};
+
+// Tiles that stop light, row-major; outside the grid everything does
+struct OcclusionGrid
+{
+    int Width = 0, Depth = 0;
+    float TileSize = 1.0f;
+    std::vector<uint8_t> Blocking;
+
+    bool Blocks(int x, int z) const
+    {
+        return x < 0 || x >= Width || z < 0 || z >= Depth || Blocking[z * Width + x] != 0;
+    }
+
+    // Walks the tiles the segment crosses on the ground plane (the walls are full height)
+    bool Visible(const glm::vec3& from, const glm::vec3& to) const
+    {
+        glm::vec2 start = glm::vec2(from.x, from.z) / TileSize;
+        glm::vec2 delta = glm::vec2(to.x, to.z) / TileSize - start;
+        int x = static_cast<int>(std::floor(start.x));
+        int z = static_cast<int>(std::floor(start.y));
+        int stepX = delta.x > 0.0f ? 1 : -1;
+        int stepZ = delta.y > 0.0f ? 1 : -1;
+
+        // Fraction of the segment at which the next tile edge on each axis is crossed
+        constexpr float NEVER = std::numeric_limits<float>::infinity();
+        float nextX = delta.x == 0.0f ? NEVER : (stepX > 0 ? x + 1 - start.x : start.x - x) / std::abs(delta.x);
+        float nextZ = delta.y == 0.0f ? NEVER : (stepZ > 0 ? z + 1 - start.y : start.y - z) / std::abs(delta.y);
+        float tileX = delta.x == 0.0f ? NEVER : 1.0f / std::abs(delta.x);
+        float tileZ = delta.y == 0.0f ? NEVER : 1.0f / std::abs(delta.y);
+
+        while (!Blocks(x, z))
+        {
+            if (std::min(nextX, nextZ) > 1.0f)
+                return true;
+            if (nextX < nextZ)
+            {
+                x += stepX;
+                nextX += tileX;
+            }
+            else
+            {
+                z += stepZ;
+                nextZ += tileZ;
+            }
+        }
+        return false;
+    }
+};
+
+// Static light reaching the texels of a lightmap, as a factor of the surface albedo
+struct Lightmap
+{
+    int Width = 0, Height = 0;
+    int CellsPerRow = 0;
+    std::vector<glm::vec3> Texels; // Row-major, empty until baked
+};
+
+// Bakes the contribution of lights that never move into a lightmap: per texel, the ambient and diffuse terms of
+// default.fs for every light in range whose line of sight through the tile grid is clear. The specular term
+// depends on the view and is left out. Batches of quads are baked by jobs on the ThreadPool; each writes its own cells.
+class LightBaker
+{
+public:
+    static constexpr int CELL_SIZE = 8;            // Texels along each side of a quad's cell
+    static constexpr size_t QUADS_PER_JOB = 64;
+    static constexpr float SURFACE_OFFSET = 0.05f; // Along the normal, so wall texels sit in the tile they face
+    static constexpr float EDGE_INSET = 0.01f;     // Keeps edge texels off the tile boundary
+
+    LightBaker(float attenuationConstant, float attenuationLinear, float attenuationQuadratic, float cutoff,
+               const glm::vec3& ambient)
+        : attenuationConstant(attenuationConstant), attenuationLinear(attenuationLinear),
+          attenuationQuadratic(attenuationQuadratic), cutoff(cutoff), ambient(ambient)
+    {}
+
+    // Size of the lightmap for a number of quads, cells laid out in a square
+    static Lightmap Layout(size_t quadCount)
+    {
+        Lightmap lightmap;
+        lightmap.CellsPerRow = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(quadCount)))));
+        int rows = std::max(1, static_cast<int>((quadCount + lightmap.CellsPerRow - 1) / lightmap.CellsPerRow));
+        lightmap.Width = lightmap.CellsPerRow * CELL_SIZE;
+        lightmap.Height = rows * CELL_SIZE;
+        return lightmap;
+    }
+
+    // Lightmap coordinates of a quad corner, (0, 0) to (1, 1): on the centers of the cell's edge texels, so that
+    // linear filtering never reads a neighbouring cell
+    static glm::vec2 Coords(const Lightmap& lightmap, size_t quad, const glm::vec2& corner)
+    {
+        glm::vec2 cell(static_cast<float>(quad % lightmap.CellsPerRow), static_cast<float>(quad / lightmap.CellsPerRow));
+        glm::vec2 texel = cell * static_cast<float>(CELL_SIZE) + 0.5f + corner * static_cast<float>(CELL_SIZE - 1);
+        return texel / glm::vec2(static_cast<float>(lightmap.Width), static_cast<float>(lightmap.Height));
+    }
+
+    // Blocks until every quad is baked. The calling thread bakes too and never waits on a queued job, so it may
+    // itself be a ThreadPool worker, e.g. an asset load, even with every other worker busy.
+    Lightmap Bake(std::span<const LightmapQuad> quads, std::span<const Light> lights, const OcclusionGrid& occluders) const
+    {
+        Lightmap lightmap = Layout(quads.size());
+        lightmap.Texels.assign(static_cast<size_t>(lightmap.Width) * lightmap.Height, glm::vec3(0.0f));
+
+        std::vector<RangedLight> rangedLights;
+        for (const auto& light : lights)
+        {
+            float range = LightRange(light.color, attenuationConstant, attenuationLinear, attenuationQuadratic, cutoff,
+                                     LightClusters::MAX_RANGE);
+            if (range > 0.0f)
+                rangedLights.push_back({ light.position, light.color, range });
+        }
+
+        // Jobs claim batches of quads until none are left; one that starts after the last batch only touches the
+        // shared counters, as the caller may have returned by then
+        auto progress = std::make_shared<BakeProgress>();
+        progress->batches = (quads.size() + QUADS_PER_JOB - 1) / QUADS_PER_JOB;
+        auto bakeBatches = [this, progress, quads, &rangedLights, &occluders, &lightmap]()
+        {
+            std::vector<const RangedLight*> nearby;
+            for (size_t batch = progress->next++; batch < progress->batches; batch = progress->next++)
+            {
+                size_t last = std::min((batch + 1) * QUADS_PER_JOB, quads.size());
+                for (size_t quad = batch * QUADS_PER_JOB; quad < last; ++quad)
+                    bakeQuad(quad, quads[quad], rangedLights, occluders, lightmap, nearby);
+                if (++progress->done == progress->batches)
+                    progress->done.notify_all();
+            }
+        };
+
+        ThreadPool& pool = ThreadPool::GetInstance();
+        size_t jobs = std::min(pool.GetNumThreads(), progress->batches);
+        for (size_t i = 1; i < jobs; ++i) // The calling thread is the first
+            pool.Submit(bakeBatches);
+        bakeBatches();
+        for (size_t done = progress->done; done < progress->batches; done = progress->done)
+            progress->done.wait(done);
+        return lightmap;
+    }
+
+private:
+    struct BakeProgress
+    {
+        size_t batches = 0;
+        std::atomic<size_t> next = 0; // Next batch to claim
+        std::atomic<size_t> done = 0; // Batches baked
+    };
+
+    struct RangedLight
+    {
+        glm::vec3 position;
+        glm::vec3 color;
+        float range;
+    };
+
+    float attenuationConstant, attenuationLinear, attenuationQuadratic;
+    float cutoff;
+    glm::vec3 ambient; // Ambient color times intensity
+
+    void bakeQuad(size_t index, const LightmapQuad& quad, const std::vector<RangedLight>& lights,
+                  const OcclusionGrid& occluders, Lightmap& lightmap, std::vector<const RangedLight*>& nearby) const
+    {
+        // Only the lights whose range reaches some part of the quad
+        glm::vec3 center = (quad.Corners[0] + quad.Corners[2]) * 0.5f;
+        float radius = glm::length(quad.Corners[2] - quad.Corners[0]) * 0.5f;
+        nearby.clear();
+        for (const auto& light : lights)
+        {
+            if (glm::length(light.position - center) < light.range + radius)
+                nearby.push_back(&light);
+        }
+
+        glm::vec3 edgeS = quad.Corners[1] - quad.Corners[0];
+        glm::vec3 edgeT = quad.Corners[3] - quad.Corners[0];
+        int cellX = static_cast<int>(index % lightmap.CellsPerRow) * CELL_SIZE;
+        int cellY = static_cast<int>(index / lightmap.CellsPerRow) * CELL_SIZE;
+        for (int j = 0; j < CELL_SIZE; ++j)
+        {
+            for (int i = 0; i < CELL_SIZE; ++i)
+            {
+                float s = std::clamp(static_cast<float>(i) / (CELL_SIZE - 1), EDGE_INSET, 1.0f - EDGE_INSET);
+                float t = std::clamp(static_cast<float>(j) / (CELL_SIZE - 1), EDGE_INSET, 1.0f - EDGE_INSET);
+                glm::vec3 position = quad.Corners[0] + edgeS * s + edgeT * t + quad.Normal * SURFACE_OFFSET;
+                lightmap.Texels[static_cast<size_t>(cellY + j) * lightmap.Width + cellX + i] =
+                    irradiance(position, quad.Normal, nearby, occluders);
+            }
+        }
+    }
+
+    // The static light term of default.fs, without the specular part
+    glm::vec3 irradiance(const glm::vec3& position, const glm::vec3& normal, const std::vector<const RangedLight*>& lights,
+                         const OcclusionGrid& occluders) const
+    {
+        glm::vec3 total(0.0f);
+        for (const RangedLight* light : lights)
+        {
+            glm::vec3 toLight = light->position - position;
+            float distance = std::max(glm::length(toLight), 1e-4f);
+            if (distance > light->range || !occluders.Visible(position, light->position))
+                continue;
+
+            float diffuse = std::max(glm::dot(normal, toLight / distance), 0.0f);
+            float attenuation = 1.0f / (attenuationConstant + attenuationLinear * distance +
+                                        attenuationQuadratic * distance * distance);
+            total += (ambient + diffuse * light->color) * attenuation * rangeWindow(distance, light->range);
+        }
+        return total;
+    }
+
+    // RangeWindow() of shaders/light_clusters.glsl
+    static float rangeWindow(float distance, float range)
+    {
+        float ratio = distance / range;
+        float window = std::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+        return window * window;
+    }
+};
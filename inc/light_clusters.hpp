@@ -0,0 +1,292 @@
+#pragma once
+
+#include "render_state.hpp"
+#include "render_stats.hpp"
+#include "shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+struct Light
+{
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+// Distance at which the brightest channel of a light, attenuated, falls to the cutoff; clamped to maxRange
+inline float LightRange(const glm::vec3& color, float attenuationConstant, float attenuationLinear,
+                        float attenuationQuadratic, float cutoff, float maxRange)
+{
+    float brightness = std::max(color.r, std::max(color.g, color.b));
+    if (brightness <= cutoff)
+        return 0.0f;
+
+    // quadratic * d^2 + linear * d + constant = brightness / cutoff
+    float target = brightness / cutoff - attenuationConstant;
+    float range = maxRange;
+    if (attenuationQuadratic > 0.0f)
+        range = (-attenuationLinear + std::sqrt(attenuationLinear * attenuationLinear + 4.0f * attenuationQuadratic * target)) /
+                (2.0f * attenuationQuadratic);
+    else if (attenuationLinear > 0.0f)
+        range = target / attenuationLinear;
+    return std::clamp(range, 0.0f, maxRange);
+}
+
+// Units of the light, cluster and index buffers, after the material units (see material.hpp)
+constexpr GLuint LIGHT_CLUSTERS_TEXTURE_UNIT = 7;
+
+// Clustered forward lighting: the view frustum is cut into screen tiles and exponential depth slices, and every
+// frame each light is binned into the clusters its range overlaps. The fragment shader finds its cluster and
+// only loops over that cluster's lights, so the cost per fragment follows the lights nearby, not in the level.
+// Three texture buffers (no SSBOs on GL 4.1), read by shaders/light_clusters.glsl:
+// - lights: two RGBA32F texels per light, position and range, then color; uploaded when the level loads,
+// - grid: offset and count of the lights of each cluster (RG32UI),
+// - indices: the light indices of all clusters, one after the other (R16UI).
+// The grid constants must match the defines in shaders/light_clusters.glsl; the far depth reaches it as the
+// CLUSTER_FAR_DEPTH define of ForwardShadingDefines().
+class LightClusters
+{
+public:
+    static constexpr int TILES_X = 16;
+    static constexpr int TILES_Y = 9;
+    static constexpr int SLICES = 24;
+    static constexpr int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static constexpr float NEAR_DEPTH = 1.0f;   // The first slice holds everything nearer
+    static constexpr float MAX_RANGE = 50.0f;
+    static constexpr size_t MAX_LIGHTS = 65536; // Indices are 16-bit
+
+    // farDepth is the camera far plane (drawDistance), lights beyond are skipped.
+    // A light's range ends where its attenuated contribution drops below cutoff.
+    LightClusters(float farDepth, float attenuationConstant, float attenuationLinear, float attenuationQuadratic, float cutoff)
+        : farDepth(std::max(farDepth, NEAR_DEPTH * 2.0f)), attenuationConstant(attenuationConstant),
+          attenuationLinear(attenuationLinear), attenuationQuadratic(attenuationQuadratic), cutoff(cutoff)
+    {
+        createBuffer(lightsBuffer, lightsTexture, GL_RGBA32F);
+        createBuffer(gridBuffer, gridTexture, GL_RG32UI);
+        createBuffer(indicesBuffer, indicesTexture, GL_R16UI);
+    }
+
+    ~LightClusters()
+    {
+        RenderState& state = RenderState::GetInstance();
+        for (GLuint* texture : { &lightsTexture, &gridTexture, &indicesTexture })
+            state.DeleteTexture(*texture);
+        for (GLuint buffer : { lightsBuffer, gridBuffer, indicesBuffer })
+        {
+            if (buffer != 0) glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // The static lights of a level; lights past MAX_LIGHTS are dropped
+    void SetLights(std::span<const Light> levelLights)
+    {
+        lights.clear();
+        std::vector<glm::vec4> texels;
+        for (const auto& light : levelLights.first(std::min(levelLights.size(), MAX_LIGHTS)))
+        {
+            float range = rangeOf(light.color);
+            lights.push_back({ light.position, range });
+            texels.emplace_back(light.position, range);
+            texels.emplace_back(light.color, 0.0f);
+        }
+        if (levelLights.size() > MAX_LIGHTS)
+            std::cerr << "ERROR::LIGHT_CLUSTERS: " << levelLights.size() - MAX_LIGHTS << " lights dropped" << std::endl;
+
+        upload(lightsBuffer, texels.size() * sizeof(glm::vec4), texels.data(), GL_STATIC_DRAW);
+    }
+
+    // Bins the lights for the camera of this frame and uploads the grid
+    void Update(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        ranges.clear();
+        for (uint32_t light = 0; light < lights.size(); ++light)
+        {
+            ClusterRange range;
+            if (!clusterRange(lights[light], viewMatrix, projectionMatrix, range))
+                continue;
+            range.light = light;
+            ranges.push_back(range);
+            forEachCluster(range, [this](int cluster) { ++counts[cluster]; });
+        }
+
+        // Offsets of every cluster's list, then the lists themselves
+        uint32_t offset = 0;
+        uint32_t maxCount = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+        {
+            grid[cluster] = { offset, counts[cluster] };
+            offset += counts[cluster];
+            maxCount = std::max(maxCount, counts[cluster]);
+        }
+        indices.resize(std::max(offset, 1u));
+        for (const auto& range : ranges)
+        {
+            forEachCluster(range, [this, &range](int cluster)
+            {
+                indices[grid[cluster].x + --counts[cluster]] = static_cast<uint16_t>(range.light);
+            });
+        }
+
+        upload(gridBuffer, grid.size() * sizeof(glm::uvec2), grid.data(), GL_STREAM_DRAW);
+        upload(indicesBuffer, indices.size() * sizeof(uint16_t), indices.data(), GL_STREAM_DRAW);
+
+        RenderStats& stats = RenderStats::GetInstance();
+        stats.VisibleLights = static_cast<unsigned int>(ranges.size());
+        stats.MaxClusterLights = maxCount;
+    }
+
+    void Bind() const
+    {
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(LIGHT_CLUSTERS_TEXTURE_UNIT + 0, GL_TEXTURE_BUFFER, lightsTexture);
+        state.BindTexture(LIGHT_CLUSTERS_TEXTURE_UNIT + 1, GL_TEXTURE_BUFFER, gridTexture);
+        state.BindTexture(LIGHT_CLUSTERS_TEXTURE_UNIT + 2, GL_TEXTURE_BUFFER, indicesTexture);
+    }
+
+    // Points the cluster samplers of a program at their units, once after linking
+    static void SetupSamplers(const Shader& shader)
+    {
+        shader.Use();
+        shader.SetInt("clusterLights", static_cast<int>(LIGHT_CLUSTERS_TEXTURE_UNIT + 0));
+        shader.SetInt("clusterGrid", static_cast<int>(LIGHT_CLUSTERS_TEXTURE_UNIT + 1));
+        shader.SetInt("clusterLightIndices", static_cast<int>(LIGHT_CLUSTERS_TEXTURE_UNIT + 2));
+    }
+
+    size_t GetLightCount() const { return lights.size(); }
+
+    // Depth slice of a view space depth, as computed by ClusterIndex() in shaders/light_clusters.glsl
+    int SliceOf(float depth) const
+    {
+        if (depth <= NEAR_DEPTH)
+            return 0;
+        float slice = std::log(depth / NEAR_DEPTH) / std::log(farDepth / NEAR_DEPTH) * static_cast<float>(SLICES - 1);
+        return std::min(SLICES - 1, 1 + static_cast<int>(slice));
+    }
+
+private:
+    struct PointLight
+    {
+        glm::vec3 position;
+        float range;
+    };
+
+    // Clusters overlapped by a light: tiles [x0, x1] x [y0, y1], slices [z0, z1]
+    struct ClusterRange
+    {
+        int x0, x1, y0, y1, z0, z1;
+        uint32_t light;
+    };
+
+    float farDepth;
+    float attenuationConstant, attenuationLinear, attenuationQuadratic;
+    float cutoff;
+    std::vector<PointLight> lights;
+    std::vector<ClusterRange> ranges;
+    std::vector<uint32_t> counts = std::vector<uint32_t>(CLUSTER_COUNT, 0);
+    std::vector<glm::uvec2> grid = std::vector<glm::uvec2>(CLUSTER_COUNT);
+    std::vector<uint16_t> indices;
+    GLuint lightsBuffer = 0, gridBuffer = 0, indicesBuffer = 0;
+    GLuint lightsTexture = 0, gridTexture = 0, indicesTexture = 0;
+
+    float rangeOf(const glm::vec3& color) const
+    {
+        return LightRange(color, attenuationConstant, attenuationLinear, attenuationQuadratic, cutoff, MAX_RANGE);
+    }
+
+    // The view space bounding box of the light, projected; false when it misses the frustum
+    bool clusterRange(const PointLight& light, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                      ClusterRange& range) const
+    {
+        if (light.range <= 0.0f)
+            return false;
+
+        glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(light.position, 1.0f));
+        float nearest = -center.z - light.range;
+        float farthest = -center.z + light.range;
+        if (farthest <= 0.0f || nearest >= farDepth)
+            return false;
+        range.z0 = SliceOf(std::max(nearest, 0.0f));
+        range.z1 = SliceOf(farthest);
+
+        // Only the part of the box in front of the camera projects: its near face is clamped in front of the eye
+        constexpr float EPSILON_DEPTH = 0.01f;
+        float zNear = std::min(center.z + light.range, -EPSILON_DEPTH);
+        float zFar = center.z - light.range;
+        glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+        for (float z : { zNear, zFar })
+        {
+            for (float x : { center.x - light.range, center.x + light.range })
+            {
+                for (float y : { center.y - light.range, center.y + light.range })
+                {
+                    glm::vec4 clip = projectionMatrix * glm::vec4(x, y, z, 1.0f);
+                    glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                    ndcMin = glm::min(ndcMin, ndc);
+                    ndcMax = glm::max(ndcMax, ndc);
+                }
+            }
+        }
+        if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+            return false;
+
+        range.x0 = tileOf(ndcMin.x, TILES_X);
+        range.x1 = tileOf(ndcMax.x, TILES_X);
+        range.y0 = tileOf(ndcMin.y, TILES_Y);
+        range.y1 = tileOf(ndcMax.y, TILES_Y);
+        return true;
+    }
+
+    static int tileOf(float ndc, int tiles)
+    {
+        return std::clamp(static_cast<int>((ndc * 0.5f + 0.5f) * static_cast<float>(tiles)), 0, tiles - 1);
+    }
+
+    template <typename Visit>
+    static void forEachCluster(const ClusterRange& range, Visit visit)
+    {
+        for (int z = range.z0; z <= range.z1; ++z)
+        {
+            for (int y = range.y0; y <= range.y1; ++y)
+            {
+                for (int x = range.x0; x <= range.x1; ++x)
+                    visit((z * TILES_Y + y) * TILES_X + x);
+            }
+        }
+    }
+
+    static void createBuffer(GLuint& buffer, GLuint& texture, GLenum format)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STATIC_DRAW); // Never empty
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glGenTextures(1, &texture);
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        state.BindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Orphans the previous storage, so a frame still reading it does not stall the upload
+    static void upload(GLuint buffer, size_t size, const void* data, GLenum usage)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (size == 0)
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, usage);
+        else
+            glBufferData(GL_TEXTURE_BUFFER, size, data, usage);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
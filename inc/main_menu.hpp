@@ -1,6 +1,7 @@
 #pragma once
 
 #include "audio_engine.hpp"
+#include "render_state.hpp"
 #include "shader.hpp"
 #include "text_renderer.hpp"
 
@@ -59,9 +60,10 @@ public:
     void Render(TextRenderer& textRenderer, const Shader& shader, int screenW, int screenH) {
         if (!Active) return;
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_DEPTH_TEST);
+        RenderState& state = RenderState::GetInstance();
+        state.Enable(GL_BLEND);
+        state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.Disable(GL_DEPTH_TEST);
 
         float startX = screenW * 0.35f;
         float startY = screenH * 0.5f;
@@ -84,7 +86,7 @@ public:
             textRenderer.RenderText(text, shader, xPos, yPos, 1.0f, color);
         }
 
-        glEnable(GL_DEPTH_TEST);
+        state.Enable(GL_DEPTH_TEST);
     }
 
 private:
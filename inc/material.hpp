@@ -0,0 +1,291 @@
+#pragma once
+
+#include "shader.hpp"
+#include "texture_array.hpp"
+#include "texture_cache.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Texture slot of a mesh, move-only like the handle it holds
+struct Texture
+{
+    TextureHandle texture;
+    std::string type;
+    std::string path;
+
+    // Another slot referencing the same texture, e.g. for a second mesh using the same material
+    Texture Share() const { return { texture.Share(), type, path }; }
+};
+
+using MaterialID = uint32_t;
+constexpr MaterialID NO_MATERIAL = 0;
+
+// Textures a material can sample, each read from its own sampler2DArray (see default.fs)
+enum class MaterialSlot : uint8_t
+{
+    Diffuse,
+    Specular,
+    Normal
+};
+constexpr size_t MATERIAL_SLOTS = 3;
+
+// Units of the material slots, in slot order. Units 0 and 1 keep the 2D samplers (level, impostors) and
+// BAKED_POSES_TEXTURE_UNIT is 3: samplers of different types must never share a unit within a program.
+constexpr GLuint MATERIAL_TEXTURE_UNIT = 4;
+
+// The page and layer each slot of a mesh samples, resolved once when the mesh gets its textures
+struct Material
+{
+    MaterialID ID = NO_MATERIAL;
+    uint32_t BindingSet = 0;                                // Same for the materials with the same page in every slot
+    std::array<int, MATERIAL_SLOTS> Pages = { -1, -1, -1 }; // Page of each slot, -1 when the slot is empty
+    glm::vec4 Layers = glm::vec4(0.0f);                     // Layer of each slot in its page
+};
+
+// Materials by integer ID, their textures packed into texture array pages: one page per size, format and sampler
+// state. Draws of materials on the same pages only differ by the layers they read, so they keep the texture
+// bindings and can be merged into one instanced draw.
+// The layers are copies of the cached 2D textures; a layer and the materials using it are recycled once the
+// last handle to its texture is gone.
+class MaterialLibrary
+{
+public:
+    // Delete copy constructor and assignment operator to enforce singleton
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // Access the singleton instance
+    static MaterialLibrary& GetInstance()
+    {
+        static MaterialLibrary instance;
+        return instance;
+    }
+
+    // Material sampling the first texture of each type, the same textures always give the same material
+    MaterialID Acquire(std::span<const Texture> textures)
+    {
+        collect();
+
+        std::array<std::weak_ptr<const Texture2D>, MATERIAL_SLOTS> sources;
+        std::array<bool, MATERIAL_SLOTS> filled{};
+        bool empty = true;
+        for (const auto& texture : textures)
+        {
+            int slot = slotOf(texture.type);
+            const Texture2D* source = texture.texture.Get();
+            if (slot < 0 || filled[slot] || !source || source->Width == 0 || source->Height == 0)
+                continue;
+            sources[slot] = texture.texture.Watch();
+            filled[slot] = true;
+            empty = false;
+        }
+        if (empty)
+            return NO_MATERIAL;
+
+        for (const auto& entry : entries)
+        {
+            if (entry.material.ID != NO_MATERIAL && sameSources(entry.sources, sources))
+                return entry.material.ID;
+        }
+
+        Material material;
+        for (size_t slot = 0; slot < MATERIAL_SLOTS; ++slot)
+        {
+            if (auto source = sources[slot].lock())
+            {
+                const Layer& layer = acquireLayer(sources[slot], *source);
+                material.Pages[slot] = layer.page;
+                material.Layers[static_cast<glm::length_t>(slot)] = static_cast<float>(layer.layer);
+            }
+        }
+        material.BindingSet = bindingSetOf(material.Pages);
+
+        if (freeIDs.empty())
+        {
+            entries.emplace_back();
+            material.ID = static_cast<MaterialID>(entries.size());
+        }
+        else
+        {
+            material.ID = freeIDs.back();
+            freeIDs.pop_back();
+        }
+        entries[material.ID - 1] = { material, sources };
+        return material.ID;
+    }
+
+    const Material& Get(MaterialID id) const
+    {
+        static const Material none;
+        return id == NO_MATERIAL || id > entries.size() ? none : entries[id - 1].material;
+    }
+
+    // Whether two materials bind the same textures, so only their layers tell them apart
+    bool SameBindings(MaterialID a, MaterialID b) const
+    {
+        return Get(a).BindingSet == Get(b).BindingSet;
+    }
+
+    // Binds the pages of the material; a page already bound is skipped by RenderState.
+    // The layers are set here for a single draw, instanced draws read them from the instance attributes.
+    void Bind(MaterialID id, const Shader& shader)
+    {
+        const Material& material = Get(id);
+        shader.SetBool("materialArrays", material.ID != NO_MATERIAL);
+        if (material.ID == NO_MATERIAL)
+            return;
+
+        for (size_t slot = 0; slot < MATERIAL_SLOTS; ++slot)
+        {
+            if (material.Pages[slot] >= 0)
+                pages[material.Pages[slot]].Bind(MATERIAL_TEXTURE_UNIT + static_cast<GLuint>(slot));
+        }
+        shader.SetVec4("materialLayers", material.Layers);
+    }
+
+    // Points the material samplers of a program at their units, once after linking
+    static void SetupSamplers(const Shader& shader)
+    {
+        shader.Use();
+        shader.SetInt("materialDiffuse", static_cast<int>(MATERIAL_TEXTURE_UNIT + static_cast<GLuint>(MaterialSlot::Diffuse)));
+        shader.SetInt("materialSpecular", static_cast<int>(MATERIAL_TEXTURE_UNIT + static_cast<GLuint>(MaterialSlot::Specular)));
+        shader.SetInt("materialNormal", static_cast<int>(MATERIAL_TEXTURE_UNIT + static_cast<GLuint>(MaterialSlot::Normal)));
+    }
+
+    size_t GetMaterialCount() const { return entries.size() - freeIDs.size(); }
+    size_t GetPageCount() const { return pages.size(); }
+
+    size_t GetResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& page : pages)
+            bytes += page.GetSizeBytes();
+        return bytes;
+    }
+
+private:
+    struct Layer
+    {
+        std::weak_ptr<const Texture2D> source;
+        int page;
+        GLint layer;
+    };
+
+    struct Entry
+    {
+        Material material;
+        std::array<std::weak_ptr<const Texture2D>, MATERIAL_SLOTS> sources;
+    };
+
+    std::vector<TextureArray> pages;
+    std::vector<Layer> layers;
+    std::vector<Entry> entries; // Indexed by material ID - 1, free entries have NO_MATERIAL
+    std::vector<MaterialID> freeIDs;
+    std::vector<std::array<int, MATERIAL_SLOTS>> bindingSets; // Indexed by binding set - 1
+
+    MaterialLibrary() = default;
+
+    static int slotOf(const std::string& type)
+    {
+        if (type == "texture_diffuse") return static_cast<int>(MaterialSlot::Diffuse);
+        if (type == "texture_specular") return static_cast<int>(MaterialSlot::Specular);
+        if (type == "texture_normal") return static_cast<int>(MaterialSlot::Normal);
+        return -1; // Custom types have no slot
+    }
+
+    // Same texture, even after it is gone: weak pointers compare by their control block
+    static bool sameOwner(const std::weak_ptr<const Texture2D>& a, const std::weak_ptr<const Texture2D>& b)
+    {
+        return !a.owner_before(b) && !b.owner_before(a);
+    }
+
+    static bool sameSources(const std::array<std::weak_ptr<const Texture2D>, MATERIAL_SLOTS>& a,
+                            const std::array<std::weak_ptr<const Texture2D>, MATERIAL_SLOTS>& b)
+    {
+        for (size_t slot = 0; slot < MATERIAL_SLOTS; ++slot)
+        {
+            if (!sameOwner(a[slot], b[slot]))
+                return false;
+        }
+        return true;
+    }
+
+    // The layer holding a copy of the texture, copied into the first page that takes it if there is none yet
+    const Layer& acquireLayer(const std::weak_ptr<const Texture2D>& watch, const Texture2D& source)
+    {
+        for (const auto& layer : layers)
+        {
+            if (sameOwner(layer.source, watch))
+                return layer;
+        }
+
+        int page = -1;
+        for (size_t i = 0; i < pages.size() && page < 0; ++i)
+        {
+            if (pages[i].Accepts(source))
+                page = static_cast<int>(i);
+        }
+        if (page < 0)
+        {
+            pages.emplace_back(source);
+            page = static_cast<int>(pages.size() - 1);
+            std::cout << "Texture array page " << page << ": " << source.Width << "x" << source.Height
+                      << (source.ImageFormat == GL_RGBA ? " RGBA" : " RGB") << std::endl;
+        }
+
+        return layers.emplace_back(Layer{ watch, page, pages[page].Add(source) });
+    }
+
+    uint32_t bindingSetOf(const std::array<int, MATERIAL_SLOTS>& materialPages)
+    {
+        for (size_t i = 0; i < bindingSets.size(); ++i)
+        {
+            if (bindingSets[i] == materialPages)
+                return static_cast<uint32_t>(i + 1);
+        }
+        bindingSets.push_back(materialPages);
+        return static_cast<uint32_t>(bindingSets.size());
+    }
+
+    // Frees the layers of the textures no longer cached, and the materials reading them. No mesh uses such a
+    // material anymore: meshes hold a handle to every texture of theirs.
+    void collect()
+    {
+        for (size_t i = 0; i < layers.size();)
+        {
+            if (layers[i].source.expired())
+            {
+                pages[layers[i].page].Remove(layers[i].layer);
+                layers[i] = std::move(layers.back());
+                layers.pop_back();
+            }
+            else
+                ++i;
+        }
+
+        for (auto& entry : entries)
+        {
+            if (entry.material.ID == NO_MATERIAL)
+                continue;
+
+            bool expired = false;
+            for (size_t slot = 0; slot < MATERIAL_SLOTS; ++slot)
+                expired |= entry.material.Pages[slot] >= 0 && entry.sources[slot].expired();
+            if (expired)
+            {
+                freeIDs.push_back(entry.material.ID);
+                entry = Entry();
+            }
+        }
+    }
+};
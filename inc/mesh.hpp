@@ -1,128 +1,219 @@
 #pragma once
 
+#include "material.hpp"
+#include "mesh_lod.hpp"
+#include "render_state.hpp"
+#include "render_stats.hpp"
 #include "shader.hpp"
-#include "texture_2D.hpp"
+#include "vertex_layout.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
-struct Vertex
-{
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::ivec4 BoneIDs;
-    glm::vec4 BoneWeights;
-};
-
-struct Texture
-{
-    Texture2D texture;
-    std::string type;
-    std::string path;
-};
-
+// Owns its vertex array and buffers: move-only, the GL objects are deleted with the mesh.
+// The vertices are packed into the compact GPU format on upload (static meshes drop the joint influences);
+// the full precision vertices and indices are only kept on the CPU when asked to (retainData).
+// The index buffer may hold a chain of LODs (see MeshLod), without one all the indices are LOD 0.
+// The textures are sampled through the material they resolve to (see MaterialLibrary), the mesh keeps their handles
+// so that they stay cached.
 class Mesh
 {
 public:
-    Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::vector<Texture>& textures)
-        : vertices(vertices), indices(indices), textures(textures), VAO(0), VBO(0), EBO(0)
+    Mesh(std::span<const Vertex> vertices, std::span<const GLuint> indices, std::vector<Texture> textures,
+         VertexFormat format = VertexFormat::Static, std::span<const MeshLod> lods = {}, bool retainData = false)
+        : textures(std::move(textures)), lods(lods.begin(), lods.end())
     {
-        setupBuffers();
+        if (this->lods.empty())
+            this->lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+        material = MaterialLibrary::GetInstance().Acquire(this->textures);
+
+        if (retainData)
+        {
+            this->vertices.assign(vertices.begin(), vertices.end());
+            this->indices.assign(indices.begin(), indices.end());
+        }
+        computeBounds(vertices);
+        setupBuffers(vertices, indices, format);
     }
 
-    void Draw(const Shader& shader) const
+    ~Mesh()
     {
+        release();
+    }
+
+    Mesh(Mesh&& other) noexcept
+        : VAO(std::exchange(other.VAO, 0)), VBO(std::exchange(other.VBO, 0)), EBO(std::exchange(other.EBO, 0)),
+          vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+          material(std::exchange(other.material, NO_MATERIAL)), lods(std::move(other.lods)), vertexCount(other.vertexCount), indexCount(other.indexCount), indexType(other.indexType), boundsMin(other.boundsMin), boundsMax(other.boundsMax)
+    {}
+
+    Mesh& operator=(Mesh&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            VAO = std::exchange(other.VAO, 0);
+            VBO = std::exchange(other.VBO, 0);
+            EBO = std::exchange(other.EBO, 0);
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            material = std::exchange(other.material, NO_MATERIAL);
+            lods = std::move(other.lods);
+            vertexCount = other.vertexCount;
+            indexCount = other.indexCount;
+            indexType = other.indexType;
+            boundsMin = other.boundsMin;
+            boundsMax = other.boundsMax;
+        }
+        return *this;
+    }
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // Meshes with fewer LODs than asked for draw their coarsest one
+    void Draw(const Shader& shader, int lod = 0) const
+    {
+        DrawVertexArray(shader, VAO, lod);
+    }
+
+    // Draws the mesh indices and material with another vertex source, e.g. a skinned copy of the vertices
+    void DrawVertexArray(const Shader& shader, GLuint vertexArray, int lod = 0) const
+    {
+        DrawWithMaterial(shader, vertexArray, material, lod);
+    }
+
+    // Same with any material. More than one instance expects the per-instance attributes (model matrix and
+    // material layers) to be set up on the vertex array.
+    void DrawWithMaterial(const Shader& shader, GLuint vertexArray, MaterialID materialID, int lod = 0, GLsizei instances = 1) const
+    {
+        const MeshLod& range = lods[std::clamp(lod, 0, GetNumLods() - 1)];
+        GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+        RenderStats& stats = RenderStats::GetInstance();
+        stats.SubmittedTriangles += range.indexCount / 3 * instances;
+        stats.FullDetailTriangles += lods[0].indexCount / 3 * instances;
+
+        // Program, textures and vertex array stay bound: the next draw only changes what differs
         shader.Use();
-        bindTextures(shader);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
+        MaterialLibrary::GetInstance().Bind(materialID, shader);
+        RenderState::GetInstance().BindVertexArray(vertexArray);
+        void* offset = (void*)(range.indexOffset * indexSize);
+        if (instances > 1)
+            glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(range.indexCount), indexType, offset, instances);
+        else
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(range.indexCount), indexType, offset);
+    }
+
+    // Feeds every vertex once, for transform feedback capture
+    void DrawPoints() const
+    {
+        RenderState::GetInstance().BindVertexArray(VAO);
+        glDrawArrays(GL_POINTS, 0, vertexCount);
     }
 
     void AddTexture(Texture texture)
     {
-        textures.push_back(texture);
+        textures.push_back(std::move(texture));
+        material = MaterialLibrary::GetInstance().Acquire(textures);
     }
 
-    std::vector<Texture> GetTextures() const { return textures; }
+    const std::vector<Texture>& GetTextures() const { return textures; }
+    MaterialID GetMaterial() const { return material; }
+    // Empty unless the mesh was created with retainData
+    std::span<const Vertex> GetVertices() const { return vertices; }
+    std::span<const GLuint> GetIndices() const { return indices; }
+    GLuint GetVAO() const { return VAO; }
+    GLuint GetEBO() const { return EBO; }
+    GLsizei GetVertexCount() const { return vertexCount; }
+    int GetNumLods() const { return static_cast<int>(lods.size()); }
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
 
     void Debug() const
     {
-        std::cout << "Vertices: " << vertices.size() << ", Indices: " << indices.size() << ", Textures: " << textures.size() << std::endl;
+        std::cout << "Vertices: " << vertexCount << ", Indices: " << indexCount << ", LODs: " << lods.size()
+                  << ", Textures: " << textures.size() << ", Material: " << material << std::endl;
         for (const auto& texture : textures)
             std::cout << "Texture: " << texture.path << ", type: " << texture.type << std::endl;
     }
 
 private:
-    GLuint VAO, VBO, EBO; // Vertex Array Object, Vertex Buffer Object, Element Buffer Object
+    GLuint VAO = 0, VBO = 0, EBO = 0; // Vertex Array Object, Vertex Buffer Object, Element Buffer Object
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    MaterialID material = NO_MATERIAL;
+    std::vector<MeshLod> lods;
+    GLsizei vertexCount = 0, indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    void release()
+    {
+        RenderState::GetInstance().DeleteVertexArray(VAO);
+        if (VBO != 0) glDeleteBuffers(1, &VBO);
+        if (EBO != 0) glDeleteBuffers(1, &EBO);
+    }
 
-    void setupBuffers()
+    // Bind pose bounding box
+    void computeBounds(std::span<const Vertex> vertices)
     {
+        if (vertices.empty()) return;
+
+        boundsMin = boundsMax = vertices[0].Position;
+        for (const auto& vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+    }
+
+    void setupBuffers(std::span<const Vertex> vertices, std::span<const GLuint> indices, VertexFormat format)
+    {
+        vertexCount = static_cast<GLsizei>(vertices.size());
+        indexCount = static_cast<GLsizei>(indices.size());
+
         // Generate buffers and arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
         // Bind VAO
-        glBindVertexArray(VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindVertexArray(VAO);
 
         // Vertex Buffer Object
+        std::vector<std::byte> packed = PackVertices(vertices, format);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
 
-        // Element Buffer Object
+        // Element Buffer Object, 16-bit whenever every vertex can be addressed with it
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        if (vertices.size() < 65536)
+        {
+            std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+            indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), GL_STATIC_DRAW);
+            indexType = GL_UNSIGNED_INT;
+        }
 
         // Vertex attributes
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        glEnableVertexAttribArray(3);
-        glVertexAttribIPointer(3, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, BoneIDs));
-
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, BoneWeights));
+        GetVertexLayout(format).Apply();
 
         // Unbind VAO to prevent accidental modifications
-        glBindVertexArray(0);
-    }
-
-    void bindTextures(const Shader& shader) const
-    {
-        GLuint diffuseCount = 0;
-        GLuint specularCount = 0;
-        GLuint normalCount = 0;
-
-        for (size_t i = 0; i < textures.size(); ++i)
-        {
-            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
-            // Determine the uniform name based on the type
-            std::string uniformName;
-            if (textures[i].type == "texture_diffuse")
-                uniformName = "texture_diffuse" + std::to_string(diffuseCount++);
-            else if (textures[i].type == "texture_specular")
-                uniformName = "texture_specular" + std::to_string(specularCount++);
-            else if (textures[i].type == "texture_normal")
-                uniformName = "texture_normal" + std::to_string(normalCount++);
-            else
-                uniformName = textures[i].type; // Fallback for custom types
-
-            shader.SetInt(uniformName, static_cast<int>(i));
-            textures[i].texture.Bind();
-        }
+        state.BindVertexArray(0);
     }
 };
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Range of a mesh index buffer drawing one level of detail. All the levels index the same vertices,
+// LOD 0 comes first and every following one has about half the triangles of the previous.
+struct MeshLod
+{
+    uint32_t indexOffset, indexCount;
+    float error; // Object space distance the simplification moved the surface by at most, 0 for LOD 0
+};
+
+// Picks the level of detail of a model from its projected size, with a hysteresis band around
+// every threshold so that a model hovering at a threshold does not flip between two levels
+class LodSelector
+{
+public:
+    LodSelector() = default;
+
+    // screenSize: projected height, as a fraction of the view height, under which LOD 1 is used;
+    // every further LOD kicks in at half the size of the previous one. 0 always keeps LOD 0.
+    LodSelector(float screenSize, float hysteresis)
+        : screenSize(screenSize), hysteresis(hysteresis)
+    {}
+
+    int Select(float projectedSize, int numLods)
+    {
+        if (screenSize <= 0.0f)
+            return lod = 0;
+
+        lod = std::min(lod, std::max(numLods - 1, 0));
+        while (lod + 1 < numLods && projectedSize < threshold(lod + 1) * (1.0f - hysteresis))
+            ++lod;
+        while (lod > 0 && projectedSize > threshold(lod) * (1.0f + hysteresis))
+            --lod;
+        return lod;
+    }
+
+    int Get() const { return lod; }
+
+private:
+    float screenSize = 0.0f;
+    float hysteresis = 0.0f;
+    int lod = 0;
+
+    float threshold(int level) const
+    {
+        return screenSize / static_cast<float>(1 << (level - 1));
+    }
+};
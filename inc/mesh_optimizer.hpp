@@ -0,0 +1,282 @@
+#pragma once
+
+#include "mesh_lod.hpp"
+#include "mesh_simplifier.hpp"
+#include "vertex_layout.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+// Import-time triangle and vertex reordering, so meshes are uploaded in a GPU friendly order:
+// - triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007),
+// - clusters of those triangles outside-in, so front faces tend to be drawn first (less overdraw),
+// - a chain of simplified LODs appended to the indices, each reordered for the cache as well,
+// - vertices in first use order, for fetch locality.
+class MeshOptimizer
+{
+public:
+    // Simulated FIFO size, small enough to hold for any GPU
+    static constexpr unsigned int CACHE_SIZE = 16;
+
+    static void Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<MeshLod>& lods,
+                         const std::string& name)
+    {
+        lods.clear();
+        if (indices.size() < 3 || vertices.empty())
+            return;
+
+        float before = ComputeACMR(indices, vertices.size());
+        std::vector<size_t> clusters = OptimizeVertexCache(indices, vertices.size());
+        OptimizeOverdraw(indices, vertices, clusters);
+        buildLods(vertices, indices, lods);
+        OptimizeVertexFetch(vertices, indices);
+        float after = ComputeACMR(std::span<const GLuint>(indices).first(lods[0].indexCount), vertices.size());
+
+        std::cout << "Optimized mesh " << name << ": " << vertices.size() << " vertices, " << indices.size() / 3
+                  << " triangles, ACMR " << before << " -> " << after << ", LODs:";
+        for (const auto& lod : lods)
+            std::cout << " " << lod.indexCount / 3;
+        std::cout << std::endl;
+    }
+
+    // Average cache miss ratio: vertex shader invocations per triangle, between 0.5 (ideal) and 3
+    static float ComputeACMR(std::span<const GLuint> indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE)
+    {
+        if (indices.size() < 3)
+            return 0.0f;
+
+        // A vertex is in the FIFO if it entered it less than cacheSize misses ago
+        std::vector<size_t> entered(vertexCount, 0);
+        size_t misses = 0;
+        for (GLuint index : indices)
+        {
+            if (entered[index] == 0 || misses - entered[index] + 1 > cacheSize)
+                entered[index] = ++misses;
+        }
+        return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    }
+
+    // Tipsify: fans around the vertex most likely still in the cache. Reorders the indices in place and
+    // returns the first triangle of every cluster, a cluster ending wherever the fanning hit a dead end.
+    static std::vector<size_t> OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount,
+                                                   unsigned int cacheSize = CACHE_SIZE)
+    {
+        size_t numTriangles = indices.size() / 3;
+
+        // Triangles adjacent to each vertex
+        std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (GLuint index : indices)
+            ++adjacencyOffsets[index + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        std::vector<size_t> adjacency(indices.size());
+        {
+            std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                adjacency[fill[indices[i]]++] = i / 3;
+        }
+
+        std::vector<int> liveTriangles(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            liveTriangles[v] = static_cast<int>(adjacencyOffsets[v + 1] - adjacencyOffsets[v]);
+
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(numTriangles, false);
+        std::vector<GLuint> deadEnds;
+        std::vector<GLuint> candidates;
+        std::vector<GLuint> output;
+        std::vector<size_t> clusters;
+        output.reserve(indices.size());
+
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;
+        long fanning = skipDeadEnd(liveTriangles, deadEnds, cursor);
+        clusters.push_back(0);
+
+        while (fanning >= 0)
+        {
+            candidates.clear();
+            for (size_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a)
+            {
+                size_t triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    GLuint v = indices[triangle * 3 + corner];
+                    output.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    --liveTriangles[v];
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // Next fanning vertex: the candidate that will still be in the cache once all its triangles are emitted
+            long next = -1;
+            size_t best = 0;
+            for (GLuint v : candidates)
+            {
+                if (liveTriangles[v] <= 0)
+                    continue;
+
+                size_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = time - cacheTime[v];
+                if (next < 0 || priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            if (next < 0)
+            {
+                next = skipDeadEnd(liveTriangles, deadEnds, cursor);
+                if (next >= 0 && output.size() / 3 > clusters.back())
+                    clusters.push_back(output.size() / 3);
+            }
+            fanning = next;
+        }
+
+        indices = std::move(output);
+        return clusters;
+    }
+
+    // Sorts the clusters by occlusion potential: the further a cluster faces out from the mesh center,
+    // the more likely it hides the rest of the mesh, so it is drawn first (Sander et al., linear-speed variant)
+    static void OptimizeOverdraw(std::vector<GLuint>& indices, std::span<const Vertex> vertices, std::vector<size_t> clusters)
+    {
+        size_t numTriangles = indices.size() / 3;
+        if (clusters.size() < 2)
+            return;
+        clusters.push_back(numTriangles);
+
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        struct Cluster
+        {
+            size_t begin, end;
+            glm::vec3 centroid, normal;
+            float potential;
+        };
+        std::vector<Cluster> sorted;
+
+        for (size_t c = 0; c + 1 < clusters.size(); ++c)
+        {
+            Cluster cluster = { clusters[c], clusters[c + 1], glm::vec3(0.0f), glm::vec3(0.0f), 0.0f };
+            float area = 0.0f;
+            for (size_t t = cluster.begin; t < cluster.end; ++t)
+            {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(normal) * 0.5f;
+
+                cluster.centroid += (p0 + p1 + p2) / 3.0f * triangleArea;
+                cluster.normal += normal;
+                area += triangleArea;
+            }
+
+            meshCentroid += cluster.centroid;
+            meshArea += area;
+            if (area > 0.0f)
+                cluster.centroid /= area;
+            sorted.push_back(cluster);
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        for (auto& cluster : sorted)
+        {
+            float length = glm::length(cluster.normal);
+            cluster.potential = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b)
+        {
+            return a.potential > b.potential;
+        });
+
+        std::vector<GLuint> output;
+        output.reserve(indices.size());
+        for (const auto& cluster : sorted)
+            output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+        indices = std::move(output);
+    }
+
+    // Renumbers the vertices in the order the indices first reference them; unreferenced vertices are dropped
+    static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        constexpr GLuint UNUSED = static_cast<GLuint>(-1);
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+
+        for (GLuint& index : indices)
+        {
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = static_cast<GLuint>(reordered.size());
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices = std::move(reordered);
+    }
+
+private:
+    // Simplifies each LOD from the previous one until it stops paying off; the LOD indices go after LOD 0
+    static void buildLods(std::span<const Vertex> vertices, std::vector<GLuint>& indices, std::vector<MeshLod>& lods)
+    {
+        lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+
+        std::vector<GLuint> previous = indices;
+        while (lods.size() < static_cast<size_t>(MeshSimplifier::MAX_LODS))
+        {
+            size_t previousTriangles = previous.size() / 3;
+            size_t target = static_cast<size_t>(previousTriangles * MeshSimplifier::LOD_REDUCTION);
+            if (target < MeshSimplifier::MIN_LOD_TRIANGLES)
+                break;
+
+            float error = 0.0f;
+            std::vector<GLuint> lod = MeshSimplifier::Simplify(vertices, previous, target, error);
+            if (lod.size() / 3 > previousTriangles * 9 / 10)
+                break;
+
+            OptimizeVertexCache(lod, vertices.size());
+            lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()),
+                             std::max(error, lods.back().error) });
+            indices.insert(indices.end(), lod.begin(), lod.end());
+            previous = std::move(lod);
+        }
+    }
+
+    // Most recently used vertex with triangles left, or else the next one in index order
+    static long skipDeadEnd(const std::vector<int>& liveTriangles, std::vector<GLuint>& deadEnds, size_t& cursor)
+    {
+        while (!deadEnds.empty())
+        {
+            GLuint v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+        for (; cursor < liveTriangles.size(); ++cursor)
+        {
+            if (liveTriangles[cursor] > 0)
+                return static_cast<long>(cursor++);
+        }
+        return -1;
+    }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "vertex_layout.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error edge collapse (Garland & Heckbert), reduced to the collapses that move a vertex onto one
+// of its neighbours. No vertex is created or modified, so the simplified indices reuse the mesh vertex
+// buffer as they are and skinned vertices keep their joint influences.
+// Vertices on open borders and on attribute seams (several vertices at the same position) never move.
+class MeshSimplifier
+{
+public:
+    static constexpr int MAX_LODS = 4;
+    static constexpr float LOD_REDUCTION = 0.5f;   // Triangles of a LOD relative to the previous one
+    static constexpr size_t MIN_LOD_TRIANGLES = 32; // No LOD is made below this
+    static constexpr float MAX_ERROR = 0.05f;       // Largest error allowed, relative to the mesh extent
+
+    // Returns indices with at most targetTriangles triangles when the error bound allows it,
+    // error receives the largest surface deviation introduced
+    static std::vector<GLuint> Simplify(std::span<const Vertex> vertices, std::span<const GLuint> indices,
+                                        size_t targetTriangles, float& error)
+    {
+        std::vector<GLuint> result(indices.begin(), indices.end());
+        error = 0.0f;
+        if (vertices.empty() || result.size() < 3)
+            return result;
+
+        std::vector<bool> locked = findLockedVertices(vertices, result);
+        std::vector<Quadric> quadrics = computeQuadrics(vertices, result);
+
+        glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+        for (const auto& vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+        double maxError = MAX_ERROR * glm::length(boundsMax - boundsMin);
+        double maxCost = maxError * maxError;
+
+        std::vector<GLuint> remap(vertices.size());
+        std::vector<bool> touched(vertices.size());
+        std::vector<Collapse> collapses;
+
+        // Every pass collapses a set of independent edges, cheapest first, then drops the degenerate triangles
+        while (result.size() / 3 > targetTriangles)
+        {
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    GLuint a = result[i + e], b = result[i + (e + 1) % 3];
+                    if (!locked[a])
+                        collapses.push_back({ a, b, collapseCost(quadrics, vertices, a, b) });
+                    if (!locked[b])
+                        collapses.push_back({ b, a, collapseCost(quadrics, vertices, b, a) });
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+            {
+                return x.cost < y.cost;
+            });
+
+            Adjacency adjacency(vertices.size(), result);
+            for (size_t v = 0; v < vertices.size(); ++v)
+            {
+                remap[v] = static_cast<GLuint>(v);
+                touched[v] = false;
+            }
+
+            size_t triangles = result.size() / 3;
+            size_t collapsed = 0;
+            for (const auto& collapse : collapses)
+            {
+                if (triangles <= targetTriangles || collapse.cost > maxCost)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to] || flips(vertices, result, adjacency, collapse))
+                    continue;
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                error = std::max(error, static_cast<float>(std::sqrt(std::max(collapse.cost, 0.0))));
+                ++collapsed;
+
+                // The neighbourhood changed: later collapses in this pass would be judged on stale geometry
+                for (size_t t : adjacency.Triangles(collapse.from))
+                {
+                    bool removed = false;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        touched[result[t * 3 + c]] = true;
+                        removed |= result[t * 3 + c] == collapse.to;
+                    }
+                    if (removed)
+                        --triangles;
+                }
+            }
+            if (collapsed == 0)
+                break;
+
+            size_t kept = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                GLuint a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+
+        return result;
+    }
+
+private:
+    // Symmetric 4x4 matrix of the squared distances to a set of planes
+    struct Quadric
+    {
+        std::array<double, 10> m{};
+
+        Quadric& operator+=(const Quadric& other)
+        {
+            for (size_t i = 0; i < m.size(); ++i)
+                m[i] += other.m[i];
+            return *this;
+        }
+
+        double Evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x
+                 + m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y
+                 + m[7] * z * z + 2.0 * m[8] * z
+                 + m[9];
+        }
+    };
+
+    struct Collapse
+    {
+        GLuint from, to;
+        double cost;
+    };
+
+    // Triangles around each vertex
+    class Adjacency
+    {
+    public:
+        Adjacency(size_t vertexCount, const std::vector<GLuint>& indices)
+            : offsets(vertexCount + 1, 0), triangles(indices.size())
+        {
+            for (GLuint index : indices)
+                ++offsets[index + 1];
+            for (size_t v = 0; v < vertexCount; ++v)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                triangles[fill[indices[i]]++] = i / 3;
+        }
+
+        std::span<const size_t> Triangles(GLuint vertex) const
+        {
+            return std::span<const size_t>(triangles).subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+        }
+
+    private:
+        std::vector<size_t> offsets;
+        std::vector<size_t> triangles;
+    };
+
+    static double collapseCost(const std::vector<Quadric>& quadrics, std::span<const Vertex> vertices, GLuint from, GLuint to)
+    {
+        Quadric sum = quadrics[from];
+        sum += quadrics[to];
+        return sum.Evaluate(vertices[to].Position);
+    }
+
+    static std::vector<Quadric> computeQuadrics(std::span<const Vertex> vertices, const std::vector<GLuint>& indices)
+    {
+        std::vector<Quadric> quadrics(vertices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const glm::vec3& p0 = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+
+            normal /= length;
+            double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, p0);
+            Quadric plane;
+            plane.m = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+            for (int corner = 0; corner < 3; ++corner)
+                quadrics[indices[i + corner]] += plane;
+        }
+        return quadrics;
+    }
+
+    // Border vertices (on an edge used by a single triangle) and seam vertices (sharing their position)
+    static std::vector<bool> findLockedVertices(std::span<const Vertex> vertices, const std::vector<GLuint>& indices)
+    {
+        std::vector<bool> locked(vertices.size(), false);
+
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                GLuint a = indices[i + e], b = indices[i + (e + 1) % 3];
+                ++edges[(static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b)];
+            }
+        }
+        for (const auto& [edge, count] : edges)
+        {
+            if (count == 1)
+            {
+                locked[edge >> 32] = true;
+                locked[edge & 0xffffffffu] = true;
+            }
+        }
+
+        std::map<std::array<uint32_t, 3>, GLuint> positions;
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            std::array<uint32_t, 3> key;
+            std::memcpy(key.data(), &vertices[v].Position, sizeof(key));
+            auto [it, inserted] = positions.emplace(key, static_cast<GLuint>(v));
+            if (!inserted)
+            {
+                locked[it->second] = true;
+                locked[v] = true;
+            }
+        }
+        return locked;
+    }
+
+    // Moving the vertex must not turn any of the remaining triangles around it over
+    static bool flips(std::span<const Vertex> vertices, const std::vector<GLuint>& indices, const Adjacency& adjacency,
+                      const Collapse& collapse)
+    {
+        const glm::vec3& target = vertices[collapse.to].Position;
+        for (size_t t : adjacency.Triangles(collapse.from))
+        {
+            glm::vec3 before[3], after[3];
+            bool removed = false;
+            for (int c = 0; c < 3; ++c)
+            {
+                GLuint index = indices[t * 3 + c];
+                removed |= index == collapse.to;
+                before[c] = vertices[index].Position;
+                after[c] = index == collapse.from ? target : before[c];
+            }
+            if (removed)
+                continue;
+
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+};
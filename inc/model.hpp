@@ -1,6 +1,9 @@
 #pragma once
 
+#include "baked_model_file.hpp"
 #include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+#include "model_data.hpp"
 #include "shader.hpp"
 #include "texture_2D.hpp"
 
@@ -20,8 +23,13 @@ class Model
 {
 public:
     Model(const std::string& path)
+        : Model(Load(path))
+    {}
+
+    // Uploads a model loaded ahead of time, e.g. on a worker thread
+    Model(ModelData&& data)
     {
-        loadModel(path);
+        upload(data);
     }
 
     void Draw(const Shader& shader) const
@@ -30,21 +38,41 @@ public:
             mesh.Draw(shader);
     }
 
+    const std::vector<Mesh>& GetMeshes() const { return meshes; }
+
     void TextureOverride(const std::string& texturePath)
     {
-        Texture2D texture2D(texturePath);
-        Texture texture({ texture2D, "texture_diffuse" });
+        Texture texture{ TextureCache::GetInstance().Acquire(texturePath), "texture_diffuse", texturePath };
 
         for (auto& mesh : meshes)
-            mesh.AddTexture(texture);
+            mesh.AddTexture(texture.Share());
     }
 
-private:
-    std::vector<Mesh> meshes;
-    std::string directory;
-    std::vector<Texture> cachedTextures;
+    // Same, with the image decoded ahead of time; the pixels are only uploaded if the texture is not cached yet
+    void TextureOverride(const std::string& texturePath, const ImageData& image)
+    {
+        Texture texture{ TextureCache::GetInstance().Acquire(texturePath, image), "texture_diffuse", texturePath };
+
+        for (auto& mesh : meshes)
+            mesh.AddTexture(texture.Share());
+    }
 
-    void loadModel(const std::string& path)
+    // Loads the baked model next to path when it is up to date, otherwise imports the source with Assimp.
+    // CPU side only, safe to call from any thread.
+    static ModelData Load(const std::string& path)
+    {
+        ModelData data;
+        std::string bakedPath = BakedModelFile::PathFor(path);
+        if (!BakedModelFile::IsUpToDate(bakedPath, path) || !BakedModelFile::Read(bakedPath, data))
+        {
+            data = ModelData();
+            Import(path, data);
+        }
+        return data;
+    }
+
+    // CPU side only, so that it also runs without a GL context (dunkelheit_bake)
+    static bool Import(const std::string& path, ModelData& data)
     {
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path,
@@ -53,28 +81,48 @@ private:
         if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode)
             throw std::runtime_error("ERROR::ASSIMP: " + std::string(importer.GetErrorString()));
 
-        directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+        data.path = path;
+        data.directory = path.substr(0, path.find_last_of('/'));
+        processNode(scene->mRootNode, scene, data);
+        return true;
+    }
+
+private:
+    std::vector<Mesh> meshes;
+
+    void upload(const ModelData& data)
+    {
+        std::vector<Texture> textures;
+        for (const auto& texture : data.textures)
+            textures.push_back(LoadTexture(texture, data));
+
+        for (const auto& mesh : data.meshes)
+        {
+            std::vector<Texture> meshTextures;
+            for (unsigned int texture : mesh.textures)
+                meshTextures.push_back(textures[texture].Share());
+            meshes.emplace_back(mesh.GetVertices(), mesh.GetIndices(), std::move(meshTextures), VertexFormat::Static, mesh.lods);
+        }
     }
 
     // Process a node recursively and convert it to meshes
-    void processNode(aiNode* node, const aiScene* scene)
+    static void processNode(aiNode* node, const aiScene* scene, ModelData& data)
     {
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.emplace_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene, data));
         }
 
         for (unsigned int i = 0; i < node->mNumChildren; i++)
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
     }
 
-    Mesh processMesh(const aiMesh* mesh, const aiScene* scene)
+    static MeshData processMesh(const aiMesh* mesh, const aiScene* scene, ModelData& data)
     {
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
-        std::vector<Texture> textures;
+        MeshData meshData;
+        std::vector<Vertex>& vertices = meshData.vertices;
+        std::vector<GLuint>& indices = meshData.indices;
 
         // Process vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
@@ -97,56 +145,14 @@ private:
             for (unsigned int j = 0; j < face.mNumIndices; ++j)
                 indices.emplace_back(face.mIndices[j]);
         }
+        MeshOptimizer::Optimize(vertices, indices, meshData.lods, mesh->mName.C_Str());
 
         // Process textures
         if (mesh->mMaterialIndex >= 0)
         {
             aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-            auto diffuseTextures = ExtractTextures(scene, material, aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseTextures.begin(), diffuseTextures.end());
-            auto specularTextures = ExtractTextures(scene, material, aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularTextures.begin(), specularTextures.end());
-            auto normalTextures = ExtractTextures(scene, material, aiTextureType_HEIGHT, "texture_normal");
-            textures.insert(textures.end(), normalTextures.begin(), normalTextures.end());
-        }
-        return Mesh(std::move(vertices), std::move(indices), std::move(textures));
-    }
-
-    // Load material textures from Assimp
-    std::vector<Texture> ExtractTextures(const aiScene* scene, aiMaterial* material, aiTextureType textureType, const std::string& typeName)
-    {
-        std::vector<Texture> textures;
-        for (unsigned int i = 0; i < material->GetTextureCount(textureType); ++i)
-        {
-            aiString textureFilename;
-            material->GetTexture(textureType, i, &textureFilename);
-
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < cachedTextures.size(); ++j)
-            {
-                if (std::strcmp(cachedTextures[j].path.data(), textureFilename.C_Str()) == 0)
-                {
-                    textures.emplace_back(cachedTextures[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-
-            if (!skip) // if texture hasn't been loaded already, load it
-            {
-                Texture2D texture2D;
-                if (const auto& texture = scene->GetEmbeddedTexture(textureFilename.C_Str()))
-                    texture2D = Texture2D(reinterpret_cast<unsigned char*>(texture->pcData), texture->mWidth, texture->mHeight);
-                else
-                    texture2D = Texture2D(std::string(directory + "/" + std::string(textureFilename.C_Str())));
-
-                Texture tex = { texture2D, typeName, std::string(textureFilename.C_Str()) };
-                textures.push_back(tex);
-                cachedTextures.push_back(tex);
-            }
+            ExtractMaterialTextures(scene, material, data, meshData.textures);
         }
-        return textures;
+        return meshData;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "animated_model.hpp"
+#include "animation_clip.hpp"
+#include "mesh.hpp"
+#include "texture_cache.hpp"
+
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Texture referenced by a model: a file next to it, or an image embedded in it
+struct TextureData
+{
+    std::string type;
+    std::string path;
+    std::vector<unsigned char> embedded; // Image file bytes (png, jpg...) when the texture is embedded
+    unsigned int embeddedWidth = 0, embeddedHeight = 0;
+};
+
+struct MeshData
+{
+    // Filled by the importer...
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    // ...or pointing into a mapped baked model
+    std::span<const Vertex> mappedVertices;
+    std::span<const GLuint> mappedIndices;
+    std::vector<unsigned int> textures; // Indices into ModelData::textures
+    std::vector<MeshLod> lods;          // Index ranges of the LOD chain, empty when the indices are a single LOD
+
+    std::span<const Vertex> GetVertices() const { return vertices.empty() ? mappedVertices : std::span<const Vertex>(vertices); }
+    std::span<const GLuint> GetIndices() const { return indices.empty() ? mappedIndices : std::span<const GLuint>(indices); }
+};
+
+// Everything a model file provides, gathered on the CPU without touching OpenGL.
+// Both the Assimp importers and the baked model reader produce it, the loaders then upload it.
+struct ModelData
+{
+    std::string path; // File the data was read from, names its embedded textures
+    std::string directory;
+    std::vector<MeshData> meshes;
+    std::vector<TextureData> textures;
+
+    // Animated models only
+    RuntimeSkeleton skeleton;
+    std::vector<Joint> joints;
+    std::vector<int> palette;
+    std::vector<AnimationClip> animations;
+
+    std::shared_ptr<const void> mapping; // Keeps the mapped views alive
+};
+
+// Collects the diffuse, specular and normal textures of a material, each texture stored once per model
+static inline void ExtractMaterialTextures(const aiScene* scene, const aiMaterial* material, ModelData& data,
+                                           std::vector<unsigned int>& meshTextures)
+{
+    const std::pair<aiTextureType, const char*> textureTypes[] = {
+        { aiTextureType_DIFFUSE, "texture_diffuse" },
+        { aiTextureType_SPECULAR, "texture_specular" },
+        { aiTextureType_HEIGHT, "texture_normal" }
+    };
+
+    for (const auto& [textureType, typeName] : textureTypes)
+    {
+        for (unsigned int i = 0; i < material->GetTextureCount(textureType); ++i)
+        {
+            aiString textureFilename;
+            material->GetTexture(textureType, i, &textureFilename);
+
+            auto it = std::find_if(data.textures.begin(), data.textures.end(), [&](const TextureData& texture)
+            {
+                return texture.path == textureFilename.C_Str() && texture.type == typeName;
+            });
+            if (it != data.textures.end())
+            {
+                meshTextures.push_back(static_cast<unsigned int>(it - data.textures.begin()));
+                continue;
+            }
+
+            TextureData texture{ typeName, textureFilename.C_Str() };
+            if (const aiTexture* embedded = scene->GetEmbeddedTexture(textureFilename.C_Str()))
+            {
+                // mHeight is 0 for compressed images, mWidth is then their size in bytes
+                size_t size = embedded->mHeight == 0 ? embedded->mWidth : embedded->mWidth * embedded->mHeight * sizeof(aiTexel);
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*>(embedded->pcData);
+                texture.embedded.assign(bytes, bytes + size);
+                texture.embeddedWidth = embedded->mWidth;
+                texture.embeddedHeight = embedded->mHeight;
+            }
+
+            meshTextures.push_back(static_cast<unsigned int>(data.textures.size()));
+            data.textures.push_back(std::move(texture));
+        }
+    }
+}
+
+// Takes the texture from the cache, creating the GL texture on first use
+static inline Texture LoadTexture(const TextureData& texture, const ModelData& data)
+{
+    TextureCache& cache = TextureCache::GetInstance();
+    if (!texture.embedded.empty())
+        return { cache.AcquireEmbedded(data.path + ":" + texture.path, texture.embedded.data(),
+                                       texture.embeddedWidth, texture.embeddedHeight), texture.type, texture.path };
+
+    return { cache.Acquire(data.directory + "/" + texture.path), texture.type, texture.path };
+}
@@ -1,11 +1,12 @@
 #pragma once
 
 #include "animated_model.hpp"
+#include "baked_model_file.hpp"
+#include "mesh_optimizer.hpp"
+#include "model_data.hpp"
 
 #include "ozz/animation/offline/raw_animation.h"
 #include "ozz/animation/offline/raw_skeleton.h"
-#include "ozz/animation/offline/animation_builder.h"
-#include "ozz/animation/offline/animation_optimizer.h"
 #include "ozz/animation/offline/skeleton_builder.h"
 
 #include <assimp/Importer.hpp>
@@ -13,9 +14,12 @@
 #include <assimp/postprocess.h>
 #include <assimp/matrix4x4.h>
 
+#include <algorithm>
 #include <iostream>
 #include <functional>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -52,7 +56,74 @@ public:
         return ozzTransform;
     }
 
-    bool LoadFromFile(const std::string& path, AnimatedModel& model)
+    bool LoadFromFile(const std::string& path, AnimatedModel& model, const AnimationCompression& compression = {})
+    {
+        ModelData data;
+        if (!Load(path, data, compression))
+            return false;
+
+        Upload(data, model);
+        return true;
+    }
+
+    // Loads the baked model next to path when it is up to date, otherwise imports the source with Assimp.
+    // CPU side only and re-entrant: every call keeps its state in data.
+    bool Load(const std::string& path, ModelData& data, const AnimationCompression& compression = {}) const
+    {
+        std::string bakedPath = BakedModelFile::PathFor(path);
+        if (BakedModelFile::IsUpToDate(bakedPath, path) && BakedModelFile::Read(bakedPath, data) && data.skeleton)
+            return true;
+
+        data = ModelData();
+        return Import(path, data, compression);
+    }
+
+    // Builds a single runtime clip up front, the models instanced from data then share it
+    static void BuildClip(ModelData& data, const std::string& name)
+    {
+        if (!data.skeleton)
+            return;
+
+        for (auto& clip : data.animations)
+            if (clip.GetName() == name)
+                clip.Get(*data.skeleton);
+    }
+
+    // GL side: creates the textures and buffers, call it from the GL thread only
+    void Upload(ModelData& data, AnimatedModel& model)
+    {
+        model.SetSkeleton(std::move(data.skeleton));
+        for (auto& clip : data.animations)
+            model.AddAnimation(std::move(clip));
+        model.SetJoints(data.joints);
+        if (!data.palette.empty())
+            model.SetPalette(data.palette);
+
+        UploadMeshes(data, model);
+    }
+
+    // GL side like Upload(), but leaves data intact: the skeleton and the clips are shared with every
+    // model instanced from it, so one import serves them all
+    void Instantiate(const ModelData& data, AnimatedModel& model)
+    {
+        InstantiateAnimation(data, model);
+        UploadMeshes(data, model);
+    }
+
+    // The CPU half of Instantiate(): skeleton, clips and palette without meshes. Runs on any thread,
+    // e.g. to sample poses on a worker thread.
+    static void InstantiateAnimation(const ModelData& data, AnimatedModel& model)
+    {
+        model.SetSkeleton(data.skeleton);
+        for (const auto& clip : data.animations)
+            model.AddAnimation(clip.Share());
+        model.SetJoints(data.joints);
+        if (!data.palette.empty())
+            model.SetPalette(data.palette);
+    }
+
+    // CPU side only, so that it also runs without a GL context (dunkelheit_bake)
+    bool Import(const std::string& path, ModelData& data, const AnimationCompression& compression = {}) const
     {
         Assimp::Importer importer;
         importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, 0.01f);
@@ -62,25 +133,25 @@ public:
         if (!pScene || (pScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !pScene->mRootNode)
             throw std::runtime_error("ERROR::ASSIMP: " + std::string(importer.GetErrorString()));
 
-        directory = path.substr(0, path.find_last_of("/"));
+        data.path = path;
+        data.directory = path.substr(0, path.find_last_of("/"));
 
-        std::vector<Joint> joints;
         std::map<std::string, int> boneMap;
 
-        // Extract skeleton and set model.skeleton
-        if (!ExtractSkeleton(pScene, joints, boneMap, model))
+        // Extract skeleton and set data.skeleton
+        if (!ExtractSkeleton(pScene, data.joints, boneMap, data))
         {
             std::cerr << "Error extracting skeleton from model \"" << path << "\"" << std::endl;
             return false;
         }
-        // Extract animations and populate model.animations
-        if (!ExtractAnimations(pScene, joints, boneMap, model))
+        // Extract animations and populate data.animations
+        if (!ExtractAnimations(pScene, data.joints, boneMap, compression, data))
         {
             std::cerr << "Error extracting animations from model \"" << path << "\"" << std::endl;
             return false;
         }
-        // Extract meshes and populate model.meshes
-        if (!ExtractMeshes(pScene, joints, boneMap, model))
+        // Extract meshes and populate data.meshes
+        if (!ExtractMeshes(pScene, data.joints, boneMap, data))
         {
             std::cerr << "Error extracting meshes from model \"" << path << "\"" << std::endl;
             return false;
@@ -93,8 +164,7 @@ public:
 
 private:
     unsigned int MAX_BONE_INFLUENCE = 4;
-    std::string directory;
-    std::vector<Texture> cachedTextures;
+    unsigned int MAX_BONES = 100; // Must match default.vs
 
     // Private constructor to prevent external instantiation
     ModelLoader() {}
@@ -102,10 +172,27 @@ private:
     ModelLoader(const ModelLoader&) = delete;
     ModelLoader& operator=(const ModelLoader&) = delete;
 
-    bool ExtractSkeleton(const aiScene* pScene, std::vector<Joint>& joints, std::map<std::string, int>& boneMap, AnimatedModel& model)
+    // Textures come from the cache, the meshes get their own buffers
+    void UploadMeshes(const ModelData& data, AnimatedModel& model)
+    {
+        std::vector<Texture> textures;
+        for (const auto& texture : data.textures)
+            textures.push_back(LoadTexture(texture, data));
+
+        for (const auto& mesh : data.meshes)
+        {
+            std::vector<Texture> meshTextures;
+            for (unsigned int texture : mesh.textures)
+                meshTextures.push_back(textures[texture].Share());
+            model.AddMesh(Mesh(mesh.GetVertices(), mesh.GetIndices(), std::move(meshTextures), VertexFormat::Skinned, mesh.lods));
+        }
+    }
+
+    bool ExtractSkeleton(const aiScene* pScene, std::vector<Joint>& joints, std::map<std::string, int>& boneMap, ModelData& data) const
     {
         // Extract joints from gltfModel and populate model.joints
         ExtractJoints(pScene->mRootNode, -1, joints, boneMap);
+        PruneJoints(pScene, joints, boneMap);
 
         if (joints.empty())
         {
@@ -113,8 +200,13 @@ private:
             return false;
         }
 
+        // Children lists built once, so the hierarchy is assembled in linear time
+        std::vector<std::vector<int>> children(joints.size());
+        for (size_t i = 0; i < joints.size(); ++i)
+            if (joints[i].parentIndex != -1)
+                children[joints[i].parentIndex].push_back(static_cast<int>(i));
+
         ozz::animation::offline::RawSkeleton rawSkeleton;
-        rawSkeleton.roots.resize(1); // Root joint
 
         std::function<void(int, ozz::animation::offline::RawSkeleton::Joint&)> buildHierarchy =
             [&](int jointIndex, ozz::animation::offline::RawSkeleton::Joint& outJoint)
@@ -124,20 +216,20 @@ private:
                 outJoint.transform = joint.localTransform;
 
                 // Add children
-                for (size_t i = 0; i < joints.size(); ++i)
-                {
-                    if (joints[i].parentIndex == jointIndex)
-                    {
-                        outJoint.children.emplace_back();
-                        buildHierarchy(i, outJoint.children.back());
-                    }
-                }
+                outJoint.children.resize(children[jointIndex].size());
+                for (size_t i = 0; i < children[jointIndex].size(); ++i)
+                    buildHierarchy(children[jointIndex][i], outJoint.children[i]);
             };
 
         // Build hierarchy starting from root joints
         for (size_t i = 0; i < joints.size(); ++i)
+        {
             if (joints[i].parentIndex == -1) // Root joints
-                buildHierarchy(i, rawSkeleton.roots.back());
+            {
+                rawSkeleton.roots.emplace_back();
+                buildHierarchy(static_cast<int>(i), rawSkeleton.roots.back());
+            }
+        }
 
         if (!rawSkeleton.Validate())
         {
@@ -146,12 +238,13 @@ private:
         }
 
         ozz::animation::offline::SkeletonBuilder skelBuilder;
-        model.SetSkeleton(std::move(skelBuilder(rawSkeleton)));
+        data.skeleton = skelBuilder(rawSkeleton);
 
         return true;
     }
 
-    bool ExtractAnimations(const aiScene* scene, std::vector<Joint>& joints, const std::map<std::string, int>& boneMap, AnimatedModel& model)
+    bool ExtractAnimations(const aiScene* scene, std::vector<Joint>& joints, const std::map<std::string, int>& boneMap,
+                           const AnimationCompression& compression, ModelData& data) const
     {
         if (!scene->HasAnimations())
         {
@@ -219,29 +312,26 @@ private:
                 continue;
             }
 
-            ozz::animation::offline::AnimationOptimizer optimizer;
-            ozz::animation::offline::RawAnimation optimizedRaw;
-            if (!optimizer(rawAnimation, model.GetSkeleton(), &optimizedRaw)) {
-                std::cerr << "Failed to optimize animation: " << rawAnimation.name << std::endl;
-                continue;
-            }
-
-            ozz::animation::offline::AnimationBuilder animBuilder;
-            model.AddAnimation(std::move(animBuilder(rawAnimation)));
+            // Only the name and duration are needed now, the clip is built the first time it plays
+            data.animations.emplace_back(std::make_shared<const RawAnimation>(std::move(rawAnimation)), compression);
         }
 
         return true;
     }
 
-    bool ExtractMeshes(const aiScene* scene, std::vector<Joint>& joints, std::map<std::string, int>& boneMap, AnimatedModel& model)
+    bool ExtractMeshes(const aiScene* scene, std::vector<Joint>& joints, std::map<std::string, int>& boneMap, ModelData& data) const
     {
+        // Palette slots are handed out only to joints that actually skin vertices
+        std::vector<int> palette;
+        std::map<int, int> jointToPalette;
+
         for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
         {
             const aiMesh* mesh = scene->mMeshes[i];
 
-            std::vector<Vertex> vertices;
-            std::vector<GLuint> indices;
-            std::vector<Texture> textures;
+            MeshData meshData;
+            std::vector<Vertex>& vertices = meshData.vertices;
+            std::vector<GLuint>& indices = meshData.indices;
 
             // Process vertices
             for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
@@ -274,6 +364,14 @@ private:
 
                 joints[boneID].invBindPose = AiToGlmMat4(bone->mOffsetMatrix);
 
+                auto paletteIt = jointToPalette.find(boneID);
+                if (paletteIt == jointToPalette.end())
+                {
+                    paletteIt = jointToPalette.emplace(boneID, static_cast<int>(palette.size())).first;
+                    palette.push_back(boneID);
+                }
+                int paletteID = paletteIt->second;
+
                 for (unsigned int j = 0; j < bone->mNumWeights; ++j)
                 {
                     unsigned int vertexID = bone->mWeights[j].mVertexId;
@@ -283,7 +381,7 @@ private:
                     {
                         if (vertices[vertexID].BoneWeights[g] == 0.0f)
                         {
-                            vertices[vertexID].BoneIDs[g] = boneID;
+                            vertices[vertexID].BoneIDs[g] = paletteID;
                             vertices[vertexID].BoneWeights[g] = weight;
                             break;
                         }
@@ -298,28 +396,74 @@ private:
                 for (unsigned int j = 0; j < face.mNumIndices; ++j)
                     indices.emplace_back(face.mIndices[j]);
             }
+            MeshOptimizer::Optimize(vertices, indices, meshData.lods, mesh->mName.C_Str());
 
             // Process textures
             if (mesh->mMaterialIndex >= 0)
             {
                 aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-                auto diffuseTextures = ExtractTextures(scene, material, aiTextureType_DIFFUSE, "texture_diffuse");
-                textures.insert(textures.end(), diffuseTextures.begin(), diffuseTextures.end());
-                auto specularTextures = ExtractTextures(scene, material, aiTextureType_SPECULAR, "texture_specular");
-                textures.insert(textures.end(), specularTextures.begin(), specularTextures.end());
-                auto normalTextures = ExtractTextures(scene, material, aiTextureType_HEIGHT, "texture_normal");
-                textures.insert(textures.end(), normalTextures.begin(), normalTextures.end());
+                ExtractMaterialTextures(scene, material, data, meshData.textures);
             }
 
-            model.AddMesh({ std::move(vertices), std::move(indices), std::move(textures) });
-            model.SetJoints(joints);
+            data.meshes.push_back(std::move(meshData));
         }
 
+        if (palette.size() > MAX_BONES)
+        {
+            std::cerr << "Skinned joints (" << palette.size() << ") exceed MAX_BONES (" << MAX_BONES << ")" << std::endl;
+            return false;
+        }
+
+        data.palette = std::move(palette);
+
         return true;
     }
 
-    void ExtractJoints(const aiNode* node, int parentIndex, std::vector<Joint>& joints, std::map<std::string, int>& boneMap)
+    // Keeps only the joints that skin vertices and their ancestors: mesh and helper nodes are dropped.
+    // Joints stay in depth-first order, so parents still come before their children.
+    void PruneJoints(const aiScene* scene, std::vector<Joint>& joints, std::map<std::string, int>& boneMap) const
+    {
+        std::vector<bool> keep(joints.size(), false);
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+        {
+            const aiMesh* mesh = scene->mMeshes[i];
+            for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+            {
+                auto it = boneMap.find(mesh->mBones[b]->mName.C_Str());
+                if (it == boneMap.end())
+                    continue;
+
+                for (int joint = it->second; joint != -1 && !keep[joint]; joint = joints[joint].parentIndex)
+                    keep[joint] = true;
+            }
+        }
+
+        // Node animation only: nothing to prune against
+        if (std::find(keep.begin(), keep.end(), true) == keep.end())
+            return;
+
+        std::vector<int> remap(joints.size(), -1);
+        std::vector<Joint> pruned;
+        for (size_t i = 0; i < joints.size(); ++i)
+        {
+            if (!keep[i])
+                continue;
+
+            remap[i] = static_cast<int>(pruned.size());
+            Joint joint = joints[i];
+            joint.parentIndex = joint.parentIndex == -1 ? -1 : remap[joint.parentIndex];
+            pruned.push_back(joint);
+        }
+
+        std::cout << "Pruned skeleton: " << joints.size() << " -> " << pruned.size() << " joints" << std::endl;
+
+        boneMap.clear();
+        for (size_t i = 0; i < pruned.size(); ++i)
+            boneMap[pruned[i].name] = static_cast<int>(i);
+        joints = std::move(pruned);
+    }
+
+    void ExtractJoints(const aiNode* node, int parentIndex, std::vector<Joint>& joints, std::map<std::string, int>& boneMap) const
     {
         int jointIndex = 0;
         std::string boneName(node->mName.data);
@@ -343,40 +487,4 @@ private:
         for (unsigned int i = 0; i < node->mNumChildren; ++i)
             ExtractJoints(node->mChildren[i], jointIndex, joints, boneMap);
     }
-
-    std::vector<Texture> ExtractTextures(const aiScene* scene, aiMaterial* material, aiTextureType textureType, const std::string& typeName)
-    {
-        std::vector<Texture> textures;
-        for (unsigned int i = 0; i < material->GetTextureCount(textureType); ++i)
-        {
-            aiString textureFilename;
-            material->GetTexture(textureType, i, &textureFilename);
-
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < cachedTextures.size(); ++j)
-            {
-                if (std::strcmp(cachedTextures[j].path.data(), textureFilename.C_Str()) == 0)
-                {
-                    textures.emplace_back(cachedTextures[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-
-            if (!skip) // if texture hasn't been loaded already, load it
-            {
-                Texture2D texture2D;
-                if (const auto& texture = scene->GetEmbeddedTexture(textureFilename.C_Str()))
-                    texture2D = Texture2D(reinterpret_cast<unsigned char*>(texture->pcData), texture->mWidth, texture->mHeight);
-                else
-                    texture2D = Texture2D(std::string(directory + "/" + std::string(textureFilename.C_Str())));
-
-                Texture tex = { texture2D, typeName, std::string(textureFilename.C_Str()) };
-                textures.push_back(tex);
-                cachedTextures.push_back(tex);
-            }
-        }
-        return textures;
-    }
-};
\ No newline at end of file
+};
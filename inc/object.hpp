@@ -3,18 +3,21 @@
 #include "cube_model.hpp"
 #include "entity.hpp"
 #include "fps_camera.hpp"
+#include "render_queue.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include <memory>
+#include <utility>
+
 class Object : public Entity
 {
 public:
-    Object(const glm::vec3 pos)
-        : position(pos)
-    {
-        model = std::make_unique<CubeModel>("assets/texture_05.png");
-    }
+    // Objects share their model, so that the queue can draw them all in one instanced draw
+    Object(const glm::vec3 pos, std::shared_ptr<const CubeModel> model)
+        : model(std::move(model)), position(pos)
+    {}
 
     void Update(const float deltaTime, const FPSCamera& camera)
     {
@@ -25,16 +28,15 @@ public:
         if (rotationY > 360.0f) rotationY -= 360.0f;
     }
 
-    void Draw(const Shader& shader) const override
+    void Submit(RenderQueue& queue) const override
     {
-        shader.Use();
-        shader.SetMat4("modelMatrix", getModelMatrix());
-        shader.SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(getModelMatrix()))));
-        model->Draw(shader);
+        glm::mat4 modelMatrix = getModelMatrix();
+        for (const auto& mesh : model->GetMeshes())
+            queue.SubmitMesh(RenderPass::Opaque, mesh, modelMatrix);
     }
 
 private:
-    std::unique_ptr<CubeModel> model;
+    std::shared_ptr<const CubeModel> model;
     glm::vec3 position;
     float rotationY = 0.0f;
     float rotationSpeed = 20.0f; // Degrees per second
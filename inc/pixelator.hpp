@@ -1,5 +1,7 @@
 #pragma once
 
+#include "render_state.hpp"
+
 #include <glad/gl.h>
 
 #include <iostream>
@@ -18,7 +20,7 @@ public:
 
     ~Pixelator()
     {
-        glDeleteFramebuffers(1, &FBO);
+        RenderState::GetInstance().DeleteFramebuffer(FBO);
         glDeleteRenderbuffers(1, &colorRBO);
         glDeleteRenderbuffers(1, &depthRBO);
     }
@@ -26,18 +28,20 @@ public:
     void BeginRender()
     {
         // 1. Bind and clear the OFF-SCREEN, LOW-RESOLUTION FBO
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindFramebuffer(GL_FRAMEBUFFER, FBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // 2. Set viewport to the LOW-RESOLUTION size for rendering
-        glViewport(0, 0, lowResWidth, lowResHeight);
+        state.Viewport(0, 0, lowResWidth, lowResHeight);
     }
 
     void EndRender()
     {
         // 1. Set the blit source/destination buffers
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);   // Destination: default screen FBO
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO); // Source: off-screen low-res FBO
+        RenderState& state = RenderState::GetInstance();
+        state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);   // Destination: default screen FBO
+        state.BindFramebuffer(GL_READ_FRAMEBUFFER, FBO); // Source: off-screen low-res FBO
         glReadBuffer(GL_COLOR_ATTACHMENT0);
 
         // 2. Blit (Copy and Stretch)
@@ -52,8 +56,8 @@ public:
             GL_NEAREST); // GL_NEAREST ensures the blocky, pixelated look
 
         // 3. Unbind FBO and restore viewport
-        glBindFramebuffer(GL_FRAMEBUFFER, 0); // Binds both READ and WRITE to default
-        glViewport(0, 0, screenWidth, screenHeight);
+        state.BindFramebuffer(GL_FRAMEBUFFER, 0); // Binds both READ and WRITE to default
+        state.Viewport(0, 0, screenWidth, screenHeight);
     }
 
 private:
@@ -81,7 +85,8 @@ private:
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
         // attach renderbuffer to framebuffer (at location = GL_COLOR_ATTACHMENT0)
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindFramebuffer(GL_FRAMEBUFFER, FBO);
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
         // specify the attachments in which to draw:
@@ -92,6 +97,6 @@ private:
         glDrawBuffers(drawbuffers.size(), drawbuffers.data());
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "ERROR::PIXELATOR: Failed to initialize FBO" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        state.BindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 };
\ No newline at end of file
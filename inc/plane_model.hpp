@@ -1,6 +1,7 @@
 #pragma once
 
 #include "basic_model.hpp"
+#include "texture_cache.hpp"
 
 #include <string>
 #include <vector>
@@ -38,11 +39,10 @@ private:
         std::vector<GLuint> indices = { 0, 1, 2, 2, 3, 0 };
 
         // Texture setup
-        std::vector<Texture> textures = {
-            { Texture2D(texturePath, { .wrapS = GL_REPEAT, .wrapT = GL_REPEAT }), "texture_diffuse", texturePath }
-        };
+        std::vector<Texture> textures;
+        textures.push_back({ TextureCache::GetInstance().Acquire(texturePath, { .wrapS = GL_REPEAT, .wrapT = GL_REPEAT }), "texture_diffuse", texturePath });
 
         // Create the mesh
-        AddMesh({ vertices, indices, textures });
+        AddMesh({ vertices, indices, std::move(textures) });
     }
 };
\ No newline at end of file
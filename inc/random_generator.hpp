@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <random>
 #include <stdexcept>
 #include <vector>
@@ -21,6 +22,7 @@ public:
     // Set a seed for the random number generator
     void SetSeed(unsigned int seed)
     {
+        std::lock_guard<std::mutex> lock(mutex);
         generator.seed(seed);
     }
 
@@ -30,6 +32,7 @@ public:
         if (min > max)
             throw std::invalid_argument("min must be less than or equal to max.");
         std::uniform_int_distribution<int> distribution(min, max);
+        std::lock_guard<std::mutex> lock(mutex);
         return distribution(generator);
     }
 
@@ -58,7 +61,11 @@ public:
 
         // Generate a random number in the range [0, totalWeight)
         std::uniform_int_distribution<int> distribution(0, totalWeight - 1);
-        int randomValue = distribution(generator);
+        int randomValue = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            randomValue = distribution(generator);
+        }
 
         // Determine the index based on the random value
         int cumulativeWeight = 0;
@@ -79,4 +86,5 @@ private:
     {}
 
     std::mt19937 generator; // Mersenne Twister random number generator
+    std::mutex mutex;       // Levels are built on a worker thread while the GL thread keeps drawing
 };
\ No newline at end of file
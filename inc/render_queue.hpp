@@ -0,0 +1,397 @@
+#pragma once
+
+#include "entity.hpp"
+#include "fragment_counter.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "render_state.hpp"
+#include "render_stats.hpp"
+#include "shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Passes in drawing order
+enum class RenderPass : uint8_t
+{
+    Opaque,      // Depth tested and written, front to back
+    Transparent, // Alpha blended, back to front
+    Overlay      // Drawn over the scene on a cleared depth buffer (held items)
+};
+
+// First of the four attribute locations holding the per-instance model matrix, then the material layers (see default.vs)
+constexpr GLuint INSTANCE_MATRIX_LOCATION = 5;
+constexpr GLuint INSTANCE_LAYERS_LOCATION = 9;
+
+// One draw of a frame. Mesh packets are drawn by the queue; custom packets (mesh == nullptr) are handed
+// back to their owner, for geometry that needs more than a model matrix (skinned models, sprites, the level).
+struct DrawPacket
+{
+    uint64_t key = 0;
+    RenderPass pass = RenderPass::Opaque;
+    const Mesh* mesh = nullptr;
+    GLuint vertexArray = 0; // The mesh VAO, or another vertex source for its indices
+    int lod = 0;
+    MaterialID material = NO_MATERIAL; // The mesh material unless another one is set
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+    float cullRadius = std::numeric_limits<float>::infinity(); // Around the model origin, never culled by default
+    float opacity = 1.0f;
+    bool depthWrite = true;
+    const Entity* owner = nullptr;
+    uint32_t part = 0; // Which of its custom draws the owner is asked for
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit key and draws them in order. Consecutive packets of the
+// same mesh and state are merged into one instanced draw, the model matrices streamed in a shared instance buffer.
+// Materials on the same texture array pages count as the same state: the instances carry their layers.
+// Packets beyond the cull distance are dropped. With a depth shader, the opaque packets are drawn twice: a
+// depth-only pre-pass, then the shading pass with an equal depth test and no depth writes, so every pixel is
+// shaded once whatever the overdraw.
+//
+// Key, most significant bits first (a single program draws the scene, so it is not part of the key):
+//   opaque and overlay: pass (2) | binding set (24) | vertex array (18) | depth (20), front to back within a state
+//   transparent:        pass (2) | inverted depth (20) | binding set (24) | vertex array (18), back to front
+class RenderQueue
+{
+public:
+    static constexpr float MAX_SORT_DISTANCE = 256.0f; // Farther packets sort at the same depth
+
+    RenderQueue()
+    {
+        glGenBuffers(1, &instanceVBO);
+    }
+
+    ~RenderQueue()
+    {
+        if (instanceVBO != 0) glDeleteBuffers(1, &instanceVBO);
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Packets whose bounds are entirely farther than distance are not drawn, 0 draws everything
+    void SetCullDistance(float distance)
+    {
+        cullDistance = distance;
+    }
+
+    // Starts collecting a frame, depths are measured from the camera
+    void Begin(const glm::vec3& cameraPosition)
+    {
+        packets.clear();
+        this->cameraPosition = cameraPosition;
+    }
+
+    // The returned packet can be adjusted (opacity, depth writes, vertex source) until Flush
+    DrawPacket& SubmitMesh(RenderPass pass, const Mesh& mesh, const glm::mat4& modelMatrix, int lod = 0)
+    {
+        DrawPacket& packet = packets.emplace_back();
+        packet.pass = pass;
+        packet.mesh = &mesh;
+        packet.vertexArray = mesh.GetVAO();
+        packet.lod = lod;
+        packet.material = mesh.GetMaterial();
+        packet.modelMatrix = modelMatrix;
+        glm::vec3 farthest = glm::max(glm::abs(mesh.GetBoundsMin()), glm::abs(mesh.GetBoundsMax()));
+        packet.cullRadius = glm::length(farthest) * maxScale(modelMatrix);
+        return packet;
+    }
+
+    DrawPacket& SubmitCustom(RenderPass pass, const Entity& owner, uint32_t part, const glm::vec3& position)
+    {
+        DrawPacket& packet = packets.emplace_back();
+        packet.pass = pass;
+        packet.owner = &owner;
+        packet.part = part;
+        packet.modelMatrix = glm::translate(glm::mat4(1.0f), position);
+        return packet;
+    }
+
+    // Sorts and draws everything submitted since Begin, with a depth pre-pass when a depth shader is given.
+    // The transparent pass uses alphaTestShader when given, the variant of shader that discards empty texels.
+    void Flush(const Shader& shader, const Shader* depthShader = nullptr, const Shader* alphaTestShader = nullptr)
+    {
+        cull();
+        for (auto& packet : packets)
+            packet.key = makeKey(packet);
+        // Stable: packets with equal keys keep their submission order
+        std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b)
+        {
+            return a.key < b.key;
+        });
+
+        buildBatches();
+
+        RenderState& state = RenderState::GetInstance();
+        RenderStats& stats = RenderStats::GetInstance();
+        stats.DrawPackets += static_cast<unsigned int>(packets.size());
+        stats.DrawBatches += static_cast<unsigned int>(batches.size());
+
+        if (depthShader)
+            drawDepthPrepass(*depthShader);
+
+        fragmentCounter.Begin();
+        MaterialLibrary& materials = MaterialLibrary::GetInstance();
+        MaterialID previousMaterial = NO_MATERIAL;
+        bool started = false;
+        RenderPass pass = RenderPass::Opaque;
+        for (const auto& batch : batches)
+        {
+            const DrawPacket& packet = packets[batch.first];
+            if (!started || packet.pass != pass)
+            {
+                beginPass(packet.pass);
+                pass = packet.pass;
+                started = true;
+            }
+            // The pre-pass already wrote the depth of this packet, only its visible fragments are shaded
+            bool prepassed = depthShader && inDepthPrepass(packet);
+            state.DepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+            state.DepthMask(packet.depthWrite && !prepassed);
+
+            // Another material on the same pages only changes the layers the draw reads
+            if (packet.mesh)
+            {
+                if (packet.material != previousMaterial && previousMaterial != NO_MATERIAL &&
+                    materials.SameBindings(packet.material, previousMaterial))
+                    ++stats.KeptMaterialBindings;
+                previousMaterial = packet.material;
+            }
+
+            bool alphaTested = alphaTestShader && packet.pass == RenderPass::Transparent;
+            drawBatch(alphaTested ? *alphaTestShader : shader, batch, packet.material);
+        }
+        fragmentCounter.End();
+        stats.ShadedFragments = static_cast<unsigned int>(fragmentCounter.GetCount());
+
+        // Leave the state the rest of the frame expects
+        if (alphaTestShader)
+            alphaTestShader->SetFloat("opacity", 1.0f);
+        shader.SetFloat("opacity", 1.0f);
+        state.DepthFunc(GL_LESS);
+        state.DepthMask(true);
+        state.Disable(GL_BLEND);
+        packets.clear();
+    }
+
+private:
+    struct Batch
+    {
+        size_t first, count;
+        size_t firstInstance; // Into instances, for batches of more than one packet
+    };
+
+    // Per-instance attributes, as laid out in the instance buffer
+    struct Instance
+    {
+        glm::mat4 modelMatrix;
+        glm::vec4 materialLayers;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<Batch> batches;
+    std::vector<Instance> instances;
+    GLuint instanceVBO = 0;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float cullDistance = 0.0f;
+    FragmentCounter fragmentCounter;
+
+    static float maxScale(const glm::mat4& m)
+    {
+        return std::sqrt(std::max({ glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                                    glm::dot(glm::vec3(m[1]), glm::vec3(m[1])),
+                                    glm::dot(glm::vec3(m[2]), glm::vec3(m[2])) }));
+    }
+
+    // Drops the packets beyond the cull distance, before anything is sorted or uploaded for them
+    void cull()
+    {
+        if (cullDistance <= 0.0f)
+            return;
+        size_t count = std::erase_if(packets, [this](const DrawPacket& packet)
+        {
+            return glm::length(glm::vec3(packet.modelMatrix[3]) - cameraPosition) - packet.cullRadius > cullDistance;
+        });
+        RenderStats::GetInstance().CulledPackets += static_cast<unsigned int>(count);
+    }
+
+    // Opaque packets that write depth; the rest keep the usual less-than test in the shading pass
+    static bool inDepthPrepass(const DrawPacket& packet)
+    {
+        return packet.pass == RenderPass::Opaque && packet.depthWrite;
+    }
+
+    // Depth of the opaque packets, without color writes, textures or materials. The triangles it draws are
+    // not counted again: the stats describe the shading pass.
+    void drawDepthPrepass(const Shader& depthShader)
+    {
+        RenderState& state = RenderState::GetInstance();
+        RenderStats& stats = RenderStats::GetInstance();
+        unsigned int submittedTriangles = stats.SubmittedTriangles;
+        unsigned int fullDetailTriangles = stats.FullDetailTriangles;
+
+        state.Disable(GL_BLEND);
+        state.ColorMask(false);
+        state.DepthFunc(GL_LESS);
+        state.DepthMask(true);
+        for (const auto& batch : batches)
+        {
+            const DrawPacket& packet = packets[batch.first];
+            if (packet.pass != RenderPass::Opaque)
+                break; // The opaque pass sorts first
+            if (inDepthPrepass(packet))
+                drawBatch(depthShader, batch, NO_MATERIAL);
+        }
+        state.ColorMask(true);
+
+        stats.SubmittedTriangles = submittedTriangles;
+        stats.FullDetailTriangles = fullDetailTriangles;
+    }
+
+    // Custom packets are handed back to their owner, mesh packets are drawn with the given material
+    void drawBatch(const Shader& shader, const Batch& batch, MaterialID material)
+    {
+        const DrawPacket& packet = packets[batch.first];
+        if (!packet.mesh)
+        {
+            packet.owner->DrawCustom(shader, packet.part);
+            return;
+        }
+
+        shader.Use();
+        shader.SetBool("animated", false);
+        shader.SetFloat("opacity", packet.opacity);
+        if (batch.count == 1)
+        {
+            shader.SetMat4("modelMatrix", packet.modelMatrix);
+            shader.SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(packet.modelMatrix))));
+            packet.mesh->DrawWithMaterial(shader, packet.vertexArray, material, packet.lod);
+        }
+        else
+            drawInstanced(shader, packet, batch, material);
+    }
+
+    uint64_t makeKey(const DrawPacket& packet) const
+    {
+        float distance = glm::length(glm::vec3(packet.modelMatrix[3]) - cameraPosition);
+        uint64_t depth = static_cast<uint64_t>(std::min(distance / MAX_SORT_DISTANCE, 1.0f) * 0xfffff);
+        uint64_t material = packet.mesh ? MaterialLibrary::GetInstance().Get(packet.material).BindingSet & 0xffffff : 0;
+        uint64_t vertexArray = packet.vertexArray & 0x3ffff;
+        uint64_t pass = static_cast<uint64_t>(packet.pass) << 62;
+
+        if (packet.pass == RenderPass::Transparent)
+            return pass | (0xfffff - depth) << 42 | material << 18 | vertexArray;
+        return pass | material << 38 | vertexArray << 20 | depth;
+    }
+
+    // Instances take their normal matrix from the model matrix, which only holds without non-uniform scale
+    static bool hasUniformScale(const glm::mat4& m)
+    {
+        float x = glm::dot(glm::vec3(m[0]), glm::vec3(m[0]));
+        float y = glm::dot(glm::vec3(m[1]), glm::vec3(m[1]));
+        float z = glm::dot(glm::vec3(m[2]), glm::vec3(m[2]));
+        return std::abs(x - y) <= 1e-4f * x && std::abs(x - z) <= 1e-4f * x;
+    }
+
+    static bool canMerge(const DrawPacket& a, const DrawPacket& b)
+    {
+        return a.mesh && a.mesh == b.mesh && a.vertexArray == b.vertexArray && a.lod == b.lod && a.pass == b.pass &&
+               a.opacity == b.opacity && a.depthWrite == b.depthWrite && hasUniformScale(b.modelMatrix) &&
+               MaterialLibrary::GetInstance().SameBindings(a.material, b.material);
+    }
+
+    // Groups the sorted packets and streams the instance attributes of the merged groups in one upload
+    void buildBatches()
+    {
+        const MaterialLibrary& materials = MaterialLibrary::GetInstance();
+        RenderStats& stats = RenderStats::GetInstance();
+        batches.clear();
+        instances.clear();
+        for (size_t i = 0; i < packets.size();)
+        {
+            size_t end = i + 1;
+            if (packets[i].mesh && hasUniformScale(packets[i].modelMatrix))
+            {
+                while (end < packets.size() && canMerge(packets[i], packets[end]))
+                    ++end;
+            }
+
+            Batch batch = { i, end - i, instances.size() };
+            if (batch.count > 1)
+            {
+                for (size_t p = i; p < end; ++p)
+                {
+                    instances.push_back({ packets[p].modelMatrix, materials.Get(packets[p].material).Layers });
+                    // A draw of its own before the materials shared pages
+                    if (packets[p].material != packets[i].material)
+                        ++stats.MergedMaterialDraws;
+                }
+            }
+            batches.push_back(batch);
+            i = end;
+        }
+
+        if (instances.empty())
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void beginPass(RenderPass pass)
+    {
+        RenderState& state = RenderState::GetInstance();
+        switch (pass)
+        {
+            case RenderPass::Opaque:
+                state.Disable(GL_BLEND);
+                break;
+            case RenderPass::Transparent:
+                state.Enable(GL_BLEND);
+                state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+            case RenderPass::Overlay:
+                state.Disable(GL_BLEND);
+                state.DepthMask(true);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                break;
+        }
+    }
+
+    // The instance attributes are pointed at the batch range of the instance buffer on the mesh vertex array,
+    // then disabled again so that single draws of the same vertex array never fetch from it
+    void drawInstanced(const Shader& shader, const DrawPacket& packet, const Batch& batch, MaterialID material)
+    {
+        RenderState::GetInstance().BindVertexArray(packet.vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            GLuint location = INSTANCE_MATRIX_LOCATION + column;
+            size_t offset = batch.firstInstance * sizeof(Instance) + offsetof(Instance, modelMatrix) + column * sizeof(glm::vec4);
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offset);
+            glVertexAttribDivisor(location, 1);
+        }
+        size_t layersOffset = batch.firstInstance * sizeof(Instance) + offsetof(Instance, materialLayers);
+        glEnableVertexAttribArray(INSTANCE_LAYERS_LOCATION);
+        glVertexAttribPointer(INSTANCE_LAYERS_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)layersOffset);
+        glVertexAttribDivisor(INSTANCE_LAYERS_LOCATION, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        shader.SetBool("instanced", true);
+        packet.mesh->DrawWithMaterial(shader, packet.vertexArray, material, packet.lod, static_cast<GLsizei>(batch.count));
+        shader.SetBool("instanced", false);
+
+        for (GLuint column = 0; column < 4; ++column)
+            glDisableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+        glDisableVertexAttribArray(INSTANCE_LAYERS_LOCATION);
+    }
+};
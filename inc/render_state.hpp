@@ -0,0 +1,279 @@
+#pragma once
+
+#include "render_stats.hpp"
+
+#include <glad/gl.h>
+
+#include <array>
+#include <cstddef>
+
+// Shadow copy of the GL state the renderer changes. Every such change goes through here: a call that would
+// not change anything is skipped, and the current state is read from the copy instead of queried from GL
+// (a glGet can stall until the driver catches up). Real and skipped changes are counted in RenderStats.
+// Objects whose bindings are tracked (programs, vertex arrays, textures, uniform buffers, framebuffers) must be
+// deleted through here too, so that a name reused by the driver is not mistaken for the deleted object.
+class RenderState
+{
+public:
+    static constexpr GLuint MAX_TEXTURE_UNITS = 32;
+    static constexpr GLuint MAX_UNIFORM_BUFFER_BINDINGS = 16;
+
+    // Delete copy constructor and assignment operator to enforce singleton
+    RenderState(const RenderState&) = delete;
+    RenderState& operator=(const RenderState&) = delete;
+
+    // Access the singleton instance
+    static RenderState& GetInstance()
+    {
+        static RenderState instance;
+        return instance;
+    }
+
+    void UseProgram(GLuint program)
+    {
+        if (update(this->program, program))
+            glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vertexArray)
+    {
+        if (update(this->vertexArray, vertexArray))
+            glBindVertexArray(vertexArray);
+    }
+
+    // unit is the index of the texture unit, not GL_TEXTURE0 + index
+    void ActiveTexture(GLuint unit)
+    {
+        if (update(activeTexture, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // Binds to the active texture unit
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        int index = targetIndex(target);
+        if (activeTexture >= MAX_TEXTURE_UNITS || index < 0)
+        {
+            count(true);
+            glBindTexture(target, texture);
+        }
+        else if (update(textures[activeTexture][index], texture))
+            glBindTexture(target, texture);
+    }
+
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        ActiveTexture(unit);
+        BindTexture(target, texture);
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void BindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        bool draw = target != GL_READ_FRAMEBUFFER;
+        bool read = target != GL_DRAW_FRAMEBUFFER;
+        if ((draw && drawFramebuffer != framebuffer) || (read && readFramebuffer != framebuffer))
+        {
+            count(true);
+            glBindFramebuffer(target, framebuffer);
+            if (draw) drawFramebuffer = framebuffer;
+            if (read) readFramebuffer = framebuffer;
+        }
+        else
+            count(false);
+    }
+
+    // Whole buffer on an indexed uniform block binding point
+    void BindUniformBuffer(GLuint binding, GLuint buffer)
+    {
+        if (binding >= MAX_UNIFORM_BUFFER_BINDINGS)
+        {
+            count(true);
+            glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        }
+        else if (update(uniformBuffers[binding], buffer))
+            glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    GLuint GetUniformBuffer(GLuint binding) const
+    {
+        return binding < MAX_UNIFORM_BUFFER_BINDINGS ? uniformBuffers[binding] : 0;
+    }
+
+    void Enable(GLenum capability) { setCapability(capability, true); }
+    void Disable(GLenum capability) { setCapability(capability, false); }
+
+    bool IsEnabled(GLenum capability) const
+    {
+        int index = capabilityIndex(capability);
+        return index >= 0 && capabilities[index];
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (update(blendFunc, { source, destination }))
+            glBlendFunc(source, destination);
+    }
+
+    void DepthMask(bool enabled)
+    {
+        if (update(depthMask, enabled))
+            glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (update(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    // All four channels at once: the renderer only turns color writes off for depth-only passes
+    void ColorMask(bool enabled)
+    {
+        if (update(colorMask, enabled))
+        {
+            GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+            glColorMask(mask, mask, mask, mask);
+        }
+    }
+
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (update(viewport, { x, y, width, height }))
+            glViewport(x, y, width, height);
+    }
+
+    const std::array<GLenum, 2>& GetBlendFunc() const { return blendFunc; }
+    const std::array<GLint, 4>& GetViewport() const { return viewport; }
+    GLuint GetProgram() const { return program; }
+    GLuint GetDrawFramebuffer() const { return drawFramebuffer; }
+    GLuint GetReadFramebuffer() const { return readFramebuffer; }
+
+    // Deleting an object the context has bound unbinds it
+    void DeleteProgram(GLuint& id)
+    {
+        if (id == 0) return;
+        glDeleteProgram(id);
+        if (program == id) program = UNKNOWN;
+        id = 0;
+    }
+
+    void DeleteVertexArray(GLuint& id)
+    {
+        if (id == 0) return;
+        glDeleteVertexArrays(1, &id);
+        if (vertexArray == id) vertexArray = 0;
+        id = 0;
+    }
+
+    void DeleteTexture(GLuint& id)
+    {
+        if (id == 0) return;
+        glDeleteTextures(1, &id);
+        for (auto& unit : textures)
+        {
+            for (GLuint& texture : unit)
+            {
+                if (texture == id) texture = 0;
+            }
+        }
+        id = 0;
+    }
+
+    void DeleteUniformBuffer(GLuint& id)
+    {
+        if (id == 0) return;
+        glDeleteBuffers(1, &id);
+        for (GLuint& buffer : uniformBuffers)
+        {
+            if (buffer == id) buffer = 0;
+        }
+        id = 0;
+    }
+
+    void DeleteFramebuffer(GLuint& id)
+    {
+        if (id == 0) return;
+        glDeleteFramebuffers(1, &id);
+        if (drawFramebuffer == id) drawFramebuffer = 0;
+        if (readFramebuffer == id) readFramebuffer = 0;
+        id = 0;
+    }
+
+private:
+    // Never a valid object name: the next bind always goes through
+    static constexpr GLuint UNKNOWN = ~0u;
+
+    static constexpr std::array<GLenum, 4> TRACKED_CAPABILITIES = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_RASTERIZER_DISCARD };
+    static constexpr std::array<GLenum, 3> TRACKED_TEXTURE_TARGETS = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER };
+
+    // The initial state of a GL context, except the viewport which the window sets
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    GLuint activeTexture = 0;
+    std::array<std::array<GLuint, TRACKED_TEXTURE_TARGETS.size()>, MAX_TEXTURE_UNITS> textures{};
+    std::array<GLuint, MAX_UNIFORM_BUFFER_BINDINGS> uniformBuffers{};
+    GLuint drawFramebuffer = 0, readFramebuffer = 0;
+    std::array<bool, TRACKED_CAPABILITIES.size()> capabilities{};
+    std::array<GLenum, 2> blendFunc = { GL_ONE, GL_ZERO };
+    bool depthMask = true;
+    GLenum depthFunc = GL_LESS;
+    bool colorMask = true;
+    std::array<GLint, 4> viewport = { -1, -1, -1, -1 };
+
+    RenderState() = default;
+
+    void count(bool changed)
+    {
+        RenderStats& stats = RenderStats::GetInstance();
+        if (changed)
+            ++stats.StateChanges;
+        else
+            ++stats.ElidedStateChanges;
+    }
+
+    // Stores the new value and tells whether GL must be called
+    template<typename T>
+    bool update(T& current, const T& value)
+    {
+        bool changed = current != value;
+        count(changed);
+        if (changed)
+            current = value;
+        return changed;
+    }
+
+    void setCapability(GLenum capability, bool enabled)
+    {
+        int index = capabilityIndex(capability);
+        if (index >= 0 && !update(capabilities[index], enabled))
+            return;
+        if (index < 0)
+            count(true);
+
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    static int capabilityIndex(GLenum capability)
+    {
+        for (size_t i = 0; i < TRACKED_CAPABILITIES.size(); ++i)
+        {
+            if (TRACKED_CAPABILITIES[i] == capability)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    static int targetIndex(GLenum target)
+    {
+        for (size_t i = 0; i < TRACKED_TEXTURE_TARGETS.size(); ++i)
+        {
+            if (TRACKED_TEXTURE_TARGETS[i] == target)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+};
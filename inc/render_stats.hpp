@@ -0,0 +1,52 @@
+#pragma once
+
+// Per-frame counters shown in the debug overlay
+class RenderStats
+{
+public:
+    // Delete copy constructor and assignment operator to enforce singleton
+    RenderStats(const RenderStats&) = delete;
+    RenderStats& operator=(const RenderStats&) = delete;
+
+    // Access the singleton instance
+    static RenderStats& GetInstance()
+    {
+        static RenderStats instance;
+        return instance;
+    }
+
+    // Called at the start of every frame
+    void Reset()
+    {
+        EvaluatedJoints = 0;
+        SubmittedTriangles = 0;
+        FullDetailTriangles = 0;
+        DrawPackets = 0;
+        DrawBatches = 0;
+        CulledPackets = 0;
+        MergedMaterialDraws = 0;
+        KeptMaterialBindings = 0;
+        VisibleLights = 0;
+        MaxClusterLights = 0;
+        ShadedFragments = 0;
+        StateChanges = 0;
+        ElidedStateChanges = 0;
+    }
+
+    unsigned int EvaluatedJoints = 0;      // Joint matrices computed on the CPU
+    unsigned int SubmittedTriangles = 0;   // Triangles drawn by meshes, at the LOD they were drawn with
+    unsigned int FullDetailTriangles = 0;  // Same, had every mesh been drawn at LOD 0
+    unsigned int DrawPackets = 0;          // Draws submitted to the render queue
+    unsigned int DrawBatches = 0;          // Same, once the compatible ones are merged into instanced draws
+    unsigned int CulledPackets = 0;        // Draws dropped beyond the draw distance
+    unsigned int MergedMaterialDraws = 0;  // Packets merged into the draw of another material on the same texture pages
+    unsigned int KeptMaterialBindings = 0; // Draws that switched material without binding other textures
+    unsigned int VisibleLights = 0;        // Lights binned into the light clusters
+    unsigned int MaxClusterLights = 0;     // Most lights any cluster holds, the worst case loop of a fragment
+    unsigned int ShadedFragments = 0;      // Fragments of the shading pass that passed the depth test, a few frames late
+    unsigned int StateChanges = 0;         // GL state changes that reached the driver (see RenderState)
+    unsigned int ElidedStateChanges = 0;   // Same, skipped because the state was already set
+
+private:
+    RenderStats() = default;
+};
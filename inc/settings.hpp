@@ -4,6 +4,7 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -20,10 +21,24 @@ public:
 
     // Shaders
     std::string ForwardShadingVertexShaderFile, ForwardShadingFragmentShaderFile;
+    std::string BonePaletteFormat;
+    bool TransformFeedbackSkinning;
 
     // PostProcessing
     bool Pixelate;
 
+    // Asset streaming
+    float AssetUploadBudget; // Milliseconds of GL uploads per frame
+
+    // Visibility
+    float DrawDistance; // Camera far plane and render queue cull distance
+    bool DepthPrepass;
+    std::string DepthPrepassFragmentShaderFile;
+
+    // Mesh LOD
+    bool MeshLOD;
+    float MeshLODScreenSize, MeshLODHysteresis;
+
     // Text renderer settings
     std::string FontFile;
     int FontSize;
@@ -33,6 +48,19 @@ public:
     // Level settings
     std::string LevelMapFile, LevelTextureFile;
     std::string EnemyModelFile;
+    bool EnemyBakedAnimation;
+    float EnemyBakedAnimationDistance, EnemyBakedAnimationSampleRate;
+    bool EnemyImpostors;
+    float EnemyImpostorDistance, EnemyImpostorFadeBand;
+    int EnemyImpostorAngles, EnemyImpostorFramesPerClip, EnemyImpostorCellSize;
+    std::string EnemyImpostorFragmentShaderFile;
+    bool EnemyAnimationLOD, EnemyAnimationCullOffscreen;
+    float EnemyAnimationFullRateDistance, EnemyAnimationMinRateDistance, EnemyAnimationMinUpdateRate;
+    float EnemyAnimationLeafJointDistance;
+    std::string EnemyAnimationTransition;
+    bool EnemyAnimationPrefetch;
+    float EnemyAnimationEvictAfter;
+    float EnemyAnimationTolerance, EnemyAnimationToleranceDistance;
 
     // Player settings
     float PlayerSpeed, PlayerCollisionRadius, PlayerHeadHeight;
@@ -51,6 +79,8 @@ public:
     glm::vec3 AmbientColor;
     float AmbientIntensity, SpecularShininess, SpecularIntensity;
     float AttenuationConstant, AttenuationLinear, AttenuationQuadratic;
+    float AttenuationCutoff; // Contribution at which a level light's range ends (light clusters)
+    bool BakedLevelLighting; // Level surfaces read the level lights from a lightmap baked at load
 
     // Audio settings
     std::string AmbientMusicFile;
@@ -82,7 +112,16 @@ inline SettingsData LoadSettingsFile(const std::string& path)
 
     settings.ForwardShadingVertexShaderFile = json.GetNested<std::string>("renderer.forwardSinglePass.shaders.vertex");
     settings.ForwardShadingFragmentShaderFile = json.GetNested<std::string>("renderer.forwardSinglePass.shaders.fragment");
+    settings.BonePaletteFormat = json.GetNested<std::string>("renderer.skinning.bonePalette");
+    settings.TransformFeedbackSkinning = json.GetNested<bool>("renderer.skinning.transformFeedback");
     settings.Pixelate = json.GetNested<bool>("renderer.postProcessing.pixelate");
+    settings.AssetUploadBudget = json.GetNested<float>("renderer.streaming.uploadBudget");
+    settings.DrawDistance = json.GetNested<float>("renderer.drawDistance");
+    settings.DepthPrepass = json.GetNested<bool>("renderer.depthPrepass.enabled");
+    settings.DepthPrepassFragmentShaderFile = json.GetNested<std::string>("renderer.depthPrepass.fragmentShader");
+    settings.MeshLOD = json.GetNested<bool>("renderer.meshLOD.enabled");
+    settings.MeshLODScreenSize = json.GetNested<float>("renderer.meshLOD.screenSize");
+    settings.MeshLODHysteresis = json.GetNested<float>("renderer.meshLOD.hysteresis");
 
     settings.FontFile = json.GetNested<std::string>("textRenderer.fontFile");
     settings.FontSize = json.GetNested<int>("textRenderer.fontSize");
@@ -94,6 +133,27 @@ inline SettingsData LoadSettingsFile(const std::string& path)
     settings.LevelTextureFile = json.GetNested<std::string>("level.textureFile");
 
     settings.EnemyModelFile = json.GetNested<std::string>("enemy.modelFile");
+    settings.EnemyBakedAnimation = json.GetNested<bool>("enemy.bakedAnimation.enabled");
+    settings.EnemyBakedAnimationDistance = json.GetNested<float>("enemy.bakedAnimation.distance");
+    settings.EnemyBakedAnimationSampleRate = json.GetNested<float>("enemy.bakedAnimation.sampleRate");
+    settings.EnemyImpostors = json.GetNested<bool>("enemy.impostors.enabled");
+    settings.EnemyImpostorDistance = json.GetNested<float>("enemy.impostors.distance");
+    settings.EnemyImpostorFadeBand = json.GetNested<float>("enemy.impostors.fadeBand");
+    settings.EnemyImpostorAngles = json.GetNested<int>("enemy.impostors.angles");
+    settings.EnemyImpostorFramesPerClip = json.GetNested<int>("enemy.impostors.framesPerClip");
+    settings.EnemyImpostorCellSize = json.GetNested<int>("enemy.impostors.cellSize");
+    settings.EnemyImpostorFragmentShaderFile = json.GetNested<std::string>("enemy.impostors.fragmentShader");
+    settings.EnemyAnimationLOD = json.GetNested<bool>("enemy.animationLOD.enabled");
+    settings.EnemyAnimationFullRateDistance = json.GetNested<float>("enemy.animationLOD.fullRateDistance");
+    settings.EnemyAnimationMinRateDistance = json.GetNested<float>("enemy.animationLOD.minRateDistance");
+    settings.EnemyAnimationMinUpdateRate = json.GetNested<float>("enemy.animationLOD.minUpdateRate");
+    settings.EnemyAnimationLeafJointDistance = json.GetNested<float>("enemy.animationLOD.leafJointDistance");
+    settings.EnemyAnimationCullOffscreen = json.GetNested<bool>("enemy.animationLOD.cullOffscreen");
+    settings.EnemyAnimationTransition = json.GetNested<std::string>("enemy.animationTransition");
+    settings.EnemyAnimationPrefetch = json.GetNested<bool>("enemy.animationClips.prefetch");
+    settings.EnemyAnimationEvictAfter = json.GetNested<float>("enemy.animationClips.evictAfter");
+    settings.EnemyAnimationTolerance = json.GetNested<float>("enemy.animationClips.compression.tolerance");
+    settings.EnemyAnimationToleranceDistance = json.GetNested<float>("enemy.animationClips.compression.distance");
 
     settings.PlayerSpeed = json.GetNested<float>("player.speed");
     settings.PlayerCollisionRadius = json.GetNested<float>("player.collisionRadius");
@@ -124,6 +184,8 @@ inline SettingsData LoadSettingsFile(const std::string& path)
     settings.AttenuationConstant = json.GetNested<float>("lighting.attenuation.constant");
     settings.AttenuationLinear = json.GetNested<float>("lighting.attenuation.linear");
     settings.AttenuationQuadratic = json.GetNested<float>("lighting.attenuation.quadratic");
+    settings.AttenuationCutoff = json.GetNested<float>("lighting.attenuation.cutoff");
+    settings.BakedLevelLighting = json.GetNested<bool>("lighting.bakedLevel");
 
     settings.AmbientMusicFile = json.GetNested<std::string>("audio.ambientMusicFile");
     settings.FootstepsSoundFiles = json.GetNested<std::vector<std::string>>("audio.footstepsSoundFiles");
@@ -137,4 +199,16 @@ inline SettingsData LoadSettingsFile(const std::string& path)
     settings.MonsterScreamSoundFile = json.GetNested<std::string>("audio.monsterScreamSoundFile");
 
     return settings;
+}
+
+// Preprocessor defines shared by every program built from the forward shading vertex shader
+inline std::vector<std::string> ForwardShadingDefines(const SettingsData& settings)
+{
+    std::vector<std::string> defines;
+    // "3x4" uploads and blends compact affine bone matrices instead of full mat4s
+    if (settings.BonePaletteFormat == "3x4")
+        defines.push_back("BONE_PALETTE_3X4");
+    // The light clusters end at the far plane, see LightClusters
+    defines.push_back("CLUSTER_FAR_DEPTH " + std::to_string(std::max(settings.DrawDistance, 2.0f)));
+    return defines;
 }
\ No newline at end of file
@@ -1,22 +1,33 @@
 #pragma once
 
+#include "render_state.hpp"
+#include "uniform_buffer.hpp"
+#include "uniform_name.hpp"
+
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <span>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+// Owns its GL program: move-only, the program is deleted with the object
 class Shader
 {
 public:
-    GLuint ID;
+    GLuint ID = 0;
 
-    Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath = "")
+    Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath = "",
+           const std::vector<std::string>& defines = {})
+        : defines(defines)
     {
         std::string vertexCode, fragmentCode, geometryCode;
 
@@ -35,8 +46,8 @@ public:
             return;
         }
 
-        GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexCode);
-        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentCode);
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, injectDefines(vertexCode));
+        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, injectDefines(fragmentCode));
 
         // Create shader program and link shaders
         ID = glCreateProgram();
@@ -46,7 +57,7 @@ public:
         // If a geometry shader is provided, compile and attach it
         if (!geometryPath.empty())
         {
-            GLuint geometry = compileShader(GL_GEOMETRY_SHADER, geometryCode);
+            GLuint geometry = compileShader(GL_GEOMETRY_SHADER, injectDefines(geometryCode));
             glAttachShader(ID, geometry);
             glDeleteShader(geometry);  // We can delete the geometry shader after linking
         }
@@ -54,34 +65,142 @@ public:
         // Link the program and check for errors
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        bindUniformBlocks();
+        reflectUniforms();
 
         // Clean up shaders once they're linked
         glDeleteShader(vertex);
         glDeleteShader(fragment);
     }
 
+    // Vertex-only program whose outputs are captured with transform feedback instead of rasterized
+    Shader(const std::string& vertexPath, const std::vector<const char*>& feedbackVaryings,
+           const std::vector<std::string>& defines = {})
+        : defines(defines)
+    {
+        std::string vertexCode;
+
+        try
+        {
+            vertexCode = readFile(vertexPath);
+        }
+        catch (const std::ifstream::failure& e)
+        {
+            std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            return;
+        }
+
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, injectDefines(vertexCode));
+
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+
+        // The varyings must be declared before linking
+        glTransformFeedbackVaryings(ID, static_cast<GLsizei>(feedbackVaryings.size()), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        bindUniformBlocks();
+        reflectUniforms();
+
+        glDeleteShader(vertex);
+    }
+
+    ~Shader()
+    {
+        RenderState::GetInstance().DeleteProgram(ID);
+    }
+
+    Shader(Shader&& other) noexcept
+        : ID(std::exchange(other.ID, 0)), uniforms(std::move(other.uniforms)), defines(std::move(other.defines))
+    {}
+
+    Shader& operator=(Shader&& other) noexcept
+    {
+        if (this != &other)
+        {
+            RenderState::GetInstance().DeleteProgram(ID);
+            ID = std::exchange(other.ID, 0);
+            uniforms = std::move(other.uniforms);
+            defines = std::move(other.defines);
+        }
+        return *this;
+    }
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
     // Use the shader program
     void Use() const
     {
-        glUseProgram(ID);
+        RenderState::GetInstance().UseProgram(ID);
     }
 
-    // Setters for uniforms
-    void SetBool(const std::string& name, bool value) const { setUniform(name, static_cast<int>(value)); }
-    void SetInt(const std::string& name, int value) const { setUniform(name, value); }
-    void SetFloat(const std::string& name, float value) const { setUniform(name, value); }
-    void SetVec2(const std::string& name, const glm::vec2& value) const { setUniform(name, value); }
-    void SetVec3(const std::string& name, const glm::vec3& value) const { setUniform(name, value); }
-    void SetVec4(const std::string& name, const glm::vec4& value) const { setUniform(name, value); }
-    void SetMat2(const std::string& name, const glm::mat2& mat) const { setUniform(name, mat); }
-    void SetMat3(const std::string& name, const glm::mat3& mat) const { setUniform(name, mat); }
-    void SetMat4(const std::string& name, const glm::mat4& mat) const { setUniform(name, mat); }
-    void SetMat4v(const std::string& name, std::vector<glm::mat4>& matrices) const { setUniform(name, matrices); }
+    // Whether the program was built with the given preprocessor define
+    bool HasDefine(std::string_view name) const
+    {
+        return std::find(defines.begin(), defines.end(), name) != defines.end();
+    }
+
+    // Uniforms outside blocks, as reflected after linking, sorted by name hash
+    struct ActiveUniform
+    {
+        uint64_t hash;
+        GLint location;
+        GLenum type;
+        GLint size; // Array length, 1 for a plain uniform
+    };
+
+    // Setters for uniforms. Names are UniformName, so literals are hashed at compile time and a draw
+    // neither allocates nor hashes; a name the program does not use resolves to -1 and is ignored by GL.
+    void SetBool(UniformName name, bool value) const { setUniform(name, static_cast<int>(value)); }
+    void SetInt(UniformName name, int value) const { setUniform(name, value); }
+    void SetFloat(UniformName name, float value) const { setUniform(name, value); }
+    void SetVec2(UniformName name, const glm::vec2& value) const { setUniform(name, value); }
+    void SetVec3(UniformName name, const glm::vec3& value) const { setUniform(name, value); }
+    void SetVec4(UniformName name, const glm::vec4& value) const { setUniform(name, value); }
+    void SetMat2(UniformName name, const glm::mat2& mat) const { setUniform(name, mat); }
+    void SetMat3(UniformName name, const glm::mat3& mat) const { setUniform(name, mat); }
+    void SetMat4(UniformName name, const glm::mat4& mat) const { setUniform(name, mat); }
+    void SetMat4v(UniformName name, std::span<const glm::mat4> matrices) const { setUniform(name, matrices); }
+    void SetVec4v(UniformName name, std::span<const glm::vec4> vectors) const { setUniform(name, vectors); }
+
+    // Location of an active uniform, -1 when the program has none by that name
+    GLint GetLocation(UniformName name) const
+    {
+        auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name.GetHash(),
+                                   [](const ActiveUniform& uniform, uint64_t hash) { return uniform.hash < hash; });
+        return it != uniforms.end() && it->hash == name.GetHash() ? it->location : -1;
+    }
+
+    const std::vector<ActiveUniform>& GetActiveUniforms() const { return uniforms; }
 
 private:
-    mutable std::unordered_map<std::string, GLint> uniformLocations;
+    std::vector<ActiveUniform> uniforms;
+    std::vector<std::string> defines;
+
+    // Insert the build time defines right after the #version directive
+    std::string injectDefines(const std::string& source) const
+    {
+        if (defines.empty())
+            return source;
+
+        std::string header;
+        for (const auto& define : defines)
+            header += "#define " + define + "\n";
 
-    // Function to read file into a string
+        size_t versionPos = source.find("#version");
+        if (versionPos == std::string::npos)
+            return header + source;
+
+        size_t lineEnd = source.find('\n', versionPos);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + header;
+
+        return source.substr(0, lineEnd + 1) + header + source.substr(lineEnd + 1);
+    }
+
+    // Function to read file into a string, #include "file" lines are replaced by the file (relative to this one)
     std::string readFile(const std::string& path)
     {
         std::ifstream file(path);
@@ -89,10 +208,33 @@ private:
             throw std::ifstream::failure("Failed to open file: " + path);
 
         std::stringstream stream;
-        stream << file.rdbuf();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t open = line.find('"');
+            size_t close = line.rfind('"');
+            if (line.rfind("#include", 0) == 0 && open != std::string::npos && close > open)
+            {
+                std::filesystem::path included = std::filesystem::path(path).parent_path() / line.substr(open + 1, close - open - 1);
+                stream << readFile(included.string());
+            }
+            else
+                stream << line << "\n";
+        }
         return stream.str();
     }
 
+    // Points the shared uniform blocks the program uses at their binding points
+    void bindUniformBlocks() const
+    {
+        for (const auto& [name, binding] : UNIFORM_BLOCK_BINDINGS)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, name);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, binding);
+        }
+    }
+
     // Function to compile a shader
     GLuint compileShader(GLenum type, const std::string& source)
     {
@@ -104,23 +246,52 @@ private:
         return shader;
     }
 
-    // Function to set uniforms (with caching of locations)
-    template<typename T>
-    void setUniform(const std::string& name, const T& value) const
+    // Lists the active uniforms once, so setting one is a binary search over a flat array.
+    // Block members have no location and are skipped; arrays are found by their name without "[0]".
+    void reflectUniforms()
     {
-        GLint location = getUniformLocation(name);
-        setUniformImpl(location, value);
+        uniforms.clear();
+        if (ID == 0)
+            return;
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(std::max(maxLength, 1));
+
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &size, &type, buffer.data());
+
+            GLint location = glGetUniformLocation(ID, buffer.data());
+            if (location < 0)
+                continue;
+
+            std::string_view name(buffer.data(), length);
+            if (name.ends_with("[0]"))
+                name.remove_suffix(3);
+            uniforms.push_back({ UniformName::Hash(name), location, type, size });
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const ActiveUniform& a, const ActiveUniform& b)
+        {
+            return a.hash < b.hash;
+        });
+        for (size_t i = 1; i < uniforms.size(); ++i)
+        {
+            if (uniforms[i].hash == uniforms[i - 1].hash)
+                std::cerr << "ERROR::SHADER::UNIFORM_HASH_COLLISION: locations " << uniforms[i - 1].location << " and "
+                          << uniforms[i].location << std::endl;
+        }
     }
 
-    // Get uniform location and cache it
-    GLint getUniformLocation(const std::string& name) const
+    template<typename T>
+    void setUniform(UniformName name, const T& value) const
     {
-        if (uniformLocations.find(name) != uniformLocations.end())
-            return uniformLocations[name];
-
-        GLint location = glGetUniformLocation(ID, name.c_str());
-        uniformLocations[name] = location;
-        return location;
+        setUniformImpl(GetLocation(name), value);
     }
 
     // Template specialization for uniform setting based on type
@@ -133,7 +304,8 @@ private:
     void setUniformImpl(GLint location, const glm::mat2& mat) const { glUniformMatrix2fv(location, 1, GL_FALSE, glm::value_ptr(mat)); }
     void setUniformImpl(GLint location, const glm::mat3& mat) const { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat)); }
     void setUniformImpl(GLint location, const glm::mat4& mat) const { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat)); }
-    void setUniformImpl(GLint location, const std::vector<glm::mat4>& matrices) const { glUniformMatrix4fv(location, (GLsizei)matrices.size(), GL_FALSE, glm::value_ptr(matrices[0])); }
+    void setUniformImpl(GLint location, std::span<const glm::mat4> matrices) const { glUniformMatrix4fv(location, (GLsizei)matrices.size(), GL_FALSE, reinterpret_cast<const GLfloat*>(matrices.data())); }
+    void setUniformImpl(GLint location, std::span<const glm::vec4> vectors) const { glUniform4fv(location, (GLsizei)vectors.size(), reinterpret_cast<const GLfloat*>(vectors.data())); }
 
     // Utility function to check compile/link errors
     void checkCompileErrors(GLuint shader, const std::string& type) const
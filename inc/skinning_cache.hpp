@@ -0,0 +1,134 @@
+#pragma once
+
+#include "basic_model.hpp"
+#include "mesh.hpp"
+#include "render_state.hpp"
+#include "shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Layout written by the skinning pass (see SKINNING_PASS in default.vs)
+struct SkinnedVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+const std::vector<const char*> SKINNING_FEEDBACK_VARYINGS = {
+    "SkinnedPosition",
+    "SkinnedNormal",
+    "SkinnedTexCoords"
+};
+
+// Holds a skinned copy of a model's vertices, captured once per pose with transform feedback.
+// Every pass drawing the model afterwards reads it as static geometry instead of re-skinning.
+class SkinningCache
+{
+public:
+    SkinningCache(const BasicModel& model)
+        : model(model)
+    {
+        setupBuffers();
+    }
+
+    ~SkinningCache()
+    {
+        for (auto& output : outputs)
+        {
+            RenderState::GetInstance().DeleteVertexArray(output.VAO);
+            glDeleteBuffers(1, &output.VBO);
+        }
+    }
+
+    SkinningCache(const SkinningCache&) = delete;
+    SkinningCache& operator=(const SkinningCache&) = delete;
+
+    // The pose key identifies the pose: nothing needs to be captured while it stays the same
+    bool NeedsUpdate(uint64_t poseKey) const
+    {
+        return !valid || poseKey != lastPoseKey;
+    }
+
+    // Runs the skinning shader over every vertex; bone uniforms must already be set on the shader
+    void Capture(const Shader& skinningShader, uint64_t poseKey)
+    {
+        const auto& meshes = model.GetMeshes();
+
+        RenderState& state = RenderState::GetInstance();
+        skinningShader.Use();
+        state.Enable(GL_RASTERIZER_DISCARD);
+        for (size_t i = 0; i < meshes.size(); ++i)
+        {
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputs[i].VBO);
+            glBeginTransformFeedback(GL_POINTS);
+            meshes[i].DrawPoints();
+            glEndTransformFeedback();
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        state.Disable(GL_RASTERIZER_DISCARD);
+
+        lastPoseKey = poseKey;
+        valid = true;
+    }
+
+    bool IsValid() const { return valid; }
+
+    void Draw(const Shader& shader) const
+    {
+        const auto& meshes = model.GetMeshes();
+
+        shader.Use();
+        shader.SetBool("animated", false);
+        for (size_t i = 0; i < meshes.size(); ++i)
+            meshes[i].DrawVertexArray(shader, outputs[i].VAO, model.GetLod());
+    }
+
+private:
+    struct Output
+    {
+        GLuint VAO, VBO;
+    };
+
+    const BasicModel& model;
+    std::vector<Output> outputs;
+    uint64_t lastPoseKey = 0;
+    bool valid = false;
+
+    void setupBuffers()
+    {
+        for (const auto& mesh : model.GetMeshes())
+        {
+            Output output;
+            glGenVertexArrays(1, &output.VAO);
+            glGenBuffers(1, &output.VBO);
+
+            RenderState& state = RenderState::GetInstance();
+            state.BindVertexArray(output.VAO);
+
+            glBindBuffer(GL_ARRAY_BUFFER, output.VBO);
+            glBufferData(GL_ARRAY_BUFFER, mesh.GetVertexCount() * sizeof(SkinnedVertex), nullptr, GL_DYNAMIC_COPY);
+
+            // Reuse the source mesh indices
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.GetEBO());
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, TexCoords));
+
+            state.BindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            outputs.push_back(output);
+        }
+    }
+};
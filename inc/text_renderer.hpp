@@ -1,5 +1,6 @@
 #pragma once
 
+#include "render_state.hpp"
 #include "shader.hpp"
 
 #include <glad/gl.h>
@@ -33,8 +34,9 @@ public:
 
     ~TextRenderer()
     {
-        glDeleteTextures(1, &atlasTexture);
-        glDeleteVertexArrays(1, &VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.DeleteTexture(atlasTexture);
+        state.DeleteVertexArray(VAO);
         glDeleteBuffers(1, &VBO);
     }
 
@@ -43,9 +45,9 @@ public:
         shader.Use();
         shader.SetVec3("textColor", color);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, atlasTexture);
-        glBindVertexArray(VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(0, GL_TEXTURE_2D, atlasTexture);
+        state.BindVertexArray(VAO);
 
         // We build a single vertex buffer for the entire string
         std::vector<float> vertices;
@@ -85,9 +87,6 @@ public:
 
         // ONE draw call for the whole string
         glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 4));
-
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
     }
 
     void BeginBatch()
@@ -124,16 +123,14 @@ public:
 
         shader.Use();
         shader.SetVec3("textColor", color);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, atlasTexture);
-        glBindVertexArray(VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(0, GL_TEXTURE_2D, atlasTexture);
+        state.BindVertexArray(VAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, batchVertices.size() * sizeof(float), batchVertices.data(), GL_DYNAMIC_DRAW);
 
         glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(batchVertices.size() / 4));
-
-        glBindVertexArray(0);
     }
 
 private:
@@ -164,7 +161,7 @@ private:
 
         // 2. Create the empty Atlas texture
         glGenTextures(1, &atlasTexture);
-        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        RenderState::GetInstance().BindTexture(GL_TEXTURE_2D, atlasTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlasWidth, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
 
         // 3. Second pass: Fill the atlas and store UVs
@@ -207,7 +204,8 @@ private:
     {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        RenderState& state = RenderState::GetInstance();
+        state.BindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
         // Setup vertex attributes (x, y, u, v)
@@ -215,6 +213,6 @@ private:
         glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        state.BindVertexArray(0);
     }
 };
@@ -1,11 +1,14 @@
 #pragma once
 
+#include "render_state.hpp"
+
 #include <glad/gl.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include <iostream>
 #include <string>
+#include <utility>
 
 struct TextureParams
 {
@@ -15,30 +18,110 @@ struct TextureParams
     GLuint filterMag = GL_NEAREST;
 };
 
+// Pixels decoded by stb_image. Decoding needs no GL context, so it can run on a worker thread.
+struct ImageData
+{
+    unsigned char* Pixels = nullptr;
+    int Width = 0, Height = 0, Channels = 0;
+
+    ImageData() = default;
+
+    // desiredChannels forces the channel count of the pixels, 0 keeps the file's
+    ImageData(const std::string& path, int desiredChannels = 0)
+    {
+        Pixels = stbi_load(path.c_str(), &Width, &Height, &Channels, desiredChannels);
+        if (!Pixels)
+            std::cerr << "ERROR::TEXTURE2D: Failed to load texture: " << path << std::endl;
+        else if (desiredChannels != 0)
+            Channels = desiredChannels;
+    }
+
+    ~ImageData()
+    {
+        if (Pixels) stbi_image_free(Pixels);
+    }
+
+    ImageData(ImageData&& other) noexcept
+        : Pixels(std::exchange(other.Pixels, nullptr)), Width(other.Width), Height(other.Height), Channels(other.Channels)
+    {}
+
+    ImageData& operator=(ImageData&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (Pixels) stbi_image_free(Pixels);
+            Pixels = std::exchange(other.Pixels, nullptr);
+            Width = other.Width;
+            Height = other.Height;
+            Channels = other.Channels;
+        }
+        return *this;
+    }
+
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+};
+
+// Owns its GL texture: move-only, the texture is deleted with the object.
+// Share textures through TextureCache handles instead of copies.
 class Texture2D
 {
 public:
-    GLuint ID;
-    GLuint Width, Height;
-    GLuint InternalFormat, ImageFormat;
+    GLuint ID = 0;
+    GLuint Width = 0, Height = 0;
+    GLuint InternalFormat = GL_RGB, ImageFormat = GL_RGB;
     GLuint WrapS, WrapT;
     GLuint FilterMin, FilterMag;
 
     Texture2D() = default;
 
+    ~Texture2D()
+    {
+        RenderState::GetInstance().DeleteTexture(ID);
+    }
+
+    Texture2D(Texture2D&& other) noexcept
+        : ID(std::exchange(other.ID, 0)), Width(other.Width), Height(other.Height),
+          InternalFormat(other.InternalFormat), ImageFormat(other.ImageFormat),
+          WrapS(other.WrapS), WrapT(other.WrapT), FilterMin(other.FilterMin), FilterMag(other.FilterMag)
+    {}
+
+    Texture2D& operator=(Texture2D&& other) noexcept
+    {
+        if (this != &other)
+        {
+            RenderState::GetInstance().DeleteTexture(ID);
+            ID = std::exchange(other.ID, 0);
+            Width = other.Width;
+            Height = other.Height;
+            InternalFormat = other.InternalFormat;
+            ImageFormat = other.ImageFormat;
+            WrapS = other.WrapS;
+            WrapT = other.WrapT;
+            FilterMin = other.FilterMin;
+            FilterMag = other.FilterMag;
+        }
+        return *this;
+    }
+
+    Texture2D(const Texture2D&) = delete;
+    Texture2D& operator=(const Texture2D&) = delete;
+
     Texture2D(const std::string& path, const TextureParams& params = {})
+        : Texture2D(ImageData(path), params)
+    {}
+
+    // Uploads an image decoded ahead of time
+    Texture2D(const ImageData& image, const TextureParams& params = {})
         : WrapS(params.wrapS), WrapT(params.wrapT),
           FilterMin(params.filterMin), FilterMag(params.filterMag)
     {
         glGenTextures(1, &ID);
-        unsigned char* image = loadImageFromPath(path.c_str());
-        if (image)
+        if (image.Pixels)
         {
-            generate(image);
-            stbi_image_free(image); // Free after texture generation
+            setParams(image.Width, image.Height, image.Channels);
+            generate(image.Pixels);
         }
-        else
-            std::cerr << "ERROR::TEXTURE2D: Failed to load texture: " << path << std::endl;
     }
 
     Texture2D(unsigned char* data, unsigned int w, unsigned int h, const TextureParams& params = {})
@@ -56,22 +139,20 @@ public:
             std::cerr << "ERROR::TEXTURE2D: Failed to load texture from data" << std::endl;
     }
 
+    // Binds to the active texture unit
     void Bind() const
     {
-        glBindTexture(GL_TEXTURE_2D, ID);
+        RenderState::GetInstance().BindTexture(GL_TEXTURE_2D, ID);
     }
 
-private:
-    // Helper function to load the image data
-    unsigned char* loadImageFromPath(const char* path)
+    // GPU memory estimate, mipmaps included
+    size_t GetSizeBytes() const
     {
-        int width, height, channels;
-        unsigned char* image = stbi_load(path, &width, &height, &channels, 0);
-        if (image)
-            setParams(width, height, channels);
-        return image;
+        size_t bytesPerPixel = ImageFormat == GL_RGBA ? 4 : 3;
+        return static_cast<size_t>(Width) * Height * bytesPerPixel * 4 / 3;
     }
 
+private:
     unsigned char* loadImageFromData(unsigned char* data, unsigned int w, unsigned int h)
     {
         int size, width, height, channels;
@@ -85,7 +166,8 @@ private:
     void generate(unsigned char* data)
     {
         // Create Texture
-        glBindTexture(GL_TEXTURE_2D, ID);
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(GL_TEXTURE_2D, ID);
         glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, ImageFormat, GL_UNSIGNED_BYTE, data);
         // Set Texture wrap and filter modes
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, WrapS);
@@ -94,7 +176,7 @@ private:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, FilterMag);
         glGenerateMipmap(GL_TEXTURE_2D);
         // Unbind texture
-        glBindTexture(GL_TEXTURE_2D, 0);
+        state.BindTexture(GL_TEXTURE_2D, 0);
     }
 
     void setParams(int width, int height, int channels)
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "render_state.hpp"
+#include "texture_2D.hpp"
+
+#include <glad/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// A GL_TEXTURE_2D_ARRAY page holding textures of one size, format and sampler state, one per layer.
+// Layers are copied on the GPU from already uploaded Texture2Ds (no glCopyImageSubData on GL 4.1: the source
+// is read through a framebuffer), and the array doubles in size when it runs out of layers.
+// Move-only, the GL texture is deleted with the object.
+class TextureArray
+{
+public:
+    static constexpr GLsizei INITIAL_LAYERS = 4;
+    static constexpr GLsizei MAX_LAYERS = 256; // GL_MAX_ARRAY_TEXTURE_LAYERS is at least 256 on GL 4.1
+
+    // The page takes the size, format and sampler state of its first texture
+    explicit TextureArray(const Texture2D& first)
+        : Width(first.Width), Height(first.Height), InternalFormat(first.InternalFormat), ImageFormat(first.ImageFormat),
+          WrapS(first.WrapS), WrapT(first.WrapT), FilterMin(first.FilterMin), FilterMag(first.FilterMag)
+    {
+        ID = allocate(INITIAL_LAYERS);
+    }
+
+    ~TextureArray()
+    {
+        RenderState::GetInstance().DeleteTexture(ID);
+    }
+
+    TextureArray(TextureArray&& other) noexcept
+        : Width(other.Width), Height(other.Height), InternalFormat(other.InternalFormat), ImageFormat(other.ImageFormat),
+          WrapS(other.WrapS), WrapT(other.WrapT), FilterMin(other.FilterMin), FilterMag(other.FilterMag),
+          ID(std::exchange(other.ID, 0)), capacity(other.capacity), used(other.used),
+          freeLayers(std::move(other.freeLayers)), mipmapsDirty(other.mipmapsDirty)
+    {}
+
+    TextureArray& operator=(TextureArray&& other) noexcept
+    {
+        if (this != &other)
+        {
+            RenderState::GetInstance().DeleteTexture(ID);
+            Width = other.Width;
+            Height = other.Height;
+            InternalFormat = other.InternalFormat;
+            ImageFormat = other.ImageFormat;
+            WrapS = other.WrapS;
+            WrapT = other.WrapT;
+            FilterMin = other.FilterMin;
+            FilterMag = other.FilterMag;
+            ID = std::exchange(other.ID, 0);
+            capacity = other.capacity;
+            used = other.used;
+            freeLayers = std::move(other.freeLayers);
+            mipmapsDirty = other.mipmapsDirty;
+        }
+        return *this;
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    bool Accepts(const Texture2D& texture) const
+    {
+        return texture.Width == Width && texture.Height == Height && texture.InternalFormat == InternalFormat &&
+               texture.WrapS == WrapS && texture.WrapT == WrapT &&
+               texture.FilterMin == FilterMin && texture.FilterMag == FilterMag &&
+               (!freeLayers.empty() || used < MAX_LAYERS);
+    }
+
+    // Copies the texture into a free layer and returns it. The ID changes when the array has to grow.
+    GLint Add(const Texture2D& texture)
+    {
+        GLint layer;
+        if (!freeLayers.empty())
+        {
+            layer = freeLayers.back();
+            freeLayers.pop_back();
+        }
+        else
+        {
+            if (used == capacity)
+                grow();
+            layer = used++;
+        }
+
+        copyLayer(GL_TEXTURE_2D, texture.ID, 0, layer);
+        mipmapsDirty = true;
+        return layer;
+    }
+
+    // The layer may be reused by the next Add
+    void Remove(GLint layer)
+    {
+        freeLayers.push_back(layer);
+    }
+
+    // Binds to a texture unit, the mipmaps of the layers added since the last bind are built first
+    void Bind(GLuint unit)
+    {
+        RenderState::GetInstance().BindTexture(unit, GL_TEXTURE_2D_ARRAY, ID);
+        if (mipmapsDirty)
+        {
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            mipmapsDirty = false;
+        }
+    }
+
+    GLuint GetID() const { return ID; }
+    GLsizei GetLayers() const { return used - static_cast<GLsizei>(freeLayers.size()); }
+
+    // GPU memory estimate, mipmaps and unused layers included
+    size_t GetSizeBytes() const
+    {
+        size_t bytesPerPixel = ImageFormat == GL_RGBA ? 4 : 3;
+        return static_cast<size_t>(Width) * Height * capacity * bytesPerPixel * 4 / 3;
+    }
+
+    GLuint Width, Height;
+    GLuint InternalFormat, ImageFormat;
+    GLuint WrapS, WrapT;
+    GLuint FilterMin, FilterMag;
+
+private:
+    GLuint ID = 0;
+    GLsizei capacity = 0;
+    GLsizei used = 0;
+    std::vector<GLint> freeLayers;
+    bool mipmapsDirty = false;
+
+    GLuint allocate(GLsizei layers)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        RenderState& state = RenderState::GetInstance();
+        state.BindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, InternalFormat, Width, Height, layers, 0, ImageFormat, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, WrapS);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, WrapT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, FilterMin);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, FilterMag);
+        state.BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        capacity = layers;
+        return texture;
+    }
+
+    // Moves the layers into an array twice the size
+    void grow()
+    {
+        GLuint old = ID;
+        ID = allocate(std::min(capacity * 2, MAX_LAYERS));
+        for (GLint layer = 0; layer < used; ++layer)
+            copyLayer(GL_TEXTURE_2D_ARRAY, old, layer, layer);
+        RenderState::GetInstance().DeleteTexture(old);
+        std::cout << "Texture array " << Width << "x" << Height << " grown to " << capacity << " layers" << std::endl;
+    }
+
+    // Level 0 of the source (a 2D texture, or one layer of an array) into a layer of this array
+    void copyLayer(GLenum sourceTarget, GLuint source, GLint sourceLayer, GLint layer)
+    {
+        RenderState& state = RenderState::GetInstance();
+        GLuint previousRead = state.GetReadFramebuffer();
+
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        state.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        if (sourceTarget == GL_TEXTURE_2D_ARRAY)
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, source, 0, sourceLayer);
+        else
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+
+        if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+        {
+            state.BindTexture(GL_TEXTURE_2D_ARRAY, ID);
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 0, 0, Width, Height);
+            state.BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+        else
+            std::cerr << "ERROR::TEXTURE_ARRAY: Texture " << source << " cannot be read into a layer" << std::endl;
+
+        state.BindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+        state.DeleteFramebuffer(framebuffer);
+    }
+};
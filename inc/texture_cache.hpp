@@ -0,0 +1,176 @@
+#pragma once
+
+#include "texture_2D.hpp"
+
+#include <glad/gl.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Reference to a cached texture. Move-only: every handle is one reference, taken from the cache
+// or with Share(), and the GL texture is freed when the last one goes away.
+class TextureHandle
+{
+public:
+    TextureHandle() = default;
+
+    TextureHandle(TextureHandle&&) noexcept = default;
+    TextureHandle& operator=(TextureHandle&&) noexcept = default;
+
+    TextureHandle(const TextureHandle&) = delete;
+    TextureHandle& operator=(const TextureHandle&) = delete;
+
+    // Another reference to the same texture
+    TextureHandle Share() const { return TextureHandle(texture); }
+
+    void Bind() const
+    {
+        if (texture)
+            texture->Bind();
+        else
+            RenderState::GetInstance().BindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    const Texture2D* Get() const { return texture.get(); }
+    // Observes the texture without keeping it resident, e.g. to notice when a copy of it can go
+    std::weak_ptr<const Texture2D> Watch() const { return texture; }
+    explicit operator bool() const { return texture != nullptr; }
+
+private:
+    friend class TextureCache;
+
+    std::shared_ptr<const Texture2D> texture;
+
+    explicit TextureHandle(std::shared_ptr<const Texture2D> texture)
+        : texture(std::move(texture))
+    {}
+};
+
+// Textures shared by everything that loads them, keyed by canonical path plus sampler parameters
+class TextureCache
+{
+public:
+    // Delete copy constructor and assignment operator to enforce singleton
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // Access the singleton instance
+    static TextureCache& GetInstance()
+    {
+        static TextureCache instance;
+        return instance;
+    }
+
+    TextureHandle Acquire(const std::string& path, const TextureParams& params = {})
+    {
+        return acquire(makeKey(canonical(path), params), [&]() { return Texture2D(path, params); });
+    }
+
+    // Same, with the image already decoded (e.g. on a worker thread); the pixels are only used on a miss
+    TextureHandle Acquire(const std::string& path, const ImageData& image, const TextureParams& params = {})
+    {
+        return acquire(makeKey(canonical(path), params), [&]() { return Texture2D(image, params); });
+    }
+
+    // Image file bytes embedded in a model, name must be unique across models
+    TextureHandle AcquireEmbedded(const std::string& name, const unsigned char* bytes, unsigned int width,
+                                  unsigned int height, const TextureParams& params = {})
+    {
+        return acquire(makeKey(name, params), [&]()
+        {
+            return Texture2D(const_cast<unsigned char*>(bytes), width, height, params);
+        });
+    }
+
+    size_t GetHits() const { return hits; }
+    size_t GetMisses() const { return misses; }
+    size_t GetResidentBytes() const { return residentBytes; }
+    size_t GetResidentTextures() const { return residentTextures; }
+
+private:
+    struct Key
+    {
+        std::string path;
+        GLuint wrapS, wrapT, filterMin, filterMag;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t hash = std::hash<std::string>{}(key.path);
+            for (GLuint value : { key.wrapS, key.wrapT, key.filterMin, key.filterMag })
+                hash = hash * 31 + value;
+            return hash;
+        }
+    };
+
+    std::unordered_map<Key, std::weak_ptr<const Texture2D>, KeyHash> textures;
+    std::mutex mutex;
+    size_t hits = 0, misses = 0;
+    size_t residentBytes = 0, residentTextures = 0;
+
+    TextureCache() = default;
+
+    static std::string canonical(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonicalPath.string();
+    }
+
+    static Key makeKey(const std::string& path, const TextureParams& params)
+    {
+        return { path, params.wrapS, params.wrapT, params.filterMin, params.filterMag };
+    }
+
+    template <typename Create>
+    TextureHandle acquire(const Key& key, Create create)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = textures.find(key);
+        if (it != textures.end())
+        {
+            if (auto texture = it->second.lock())
+            {
+                ++hits;
+                return TextureHandle(std::move(texture));
+            }
+        }
+
+        ++misses;
+        Texture2D* created = new Texture2D(create());
+        size_t bytes = created->GetSizeBytes();
+        residentBytes += bytes;
+        ++residentTextures;
+
+        // The last handle going away deletes the GL texture and drops the entry
+        std::shared_ptr<const Texture2D> texture(created, [this, key, bytes](const Texture2D* texture)
+        {
+            release(key, bytes);
+            delete texture;
+        });
+        textures[key] = texture;
+        return TextureHandle(std::move(texture));
+    }
+
+    void release(const Key& key, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        residentBytes -= bytes;
+        --residentTextures;
+
+        auto it = textures.find(key);
+        if (it != textures.end() && it->second.expired())
+            textures.erase(it);
+    }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads, one per core, for CPU-only jobs such as model imports.
+// Jobs must not touch OpenGL: their results are handed back to the GL thread through the futures.
+class ThreadPool
+{
+public:
+    // Delete copy constructor and assignment operator to enforce singleton
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Access the singleton instance
+    static ThreadPool& GetInstance()
+    {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> Submit(F&& job)
+    {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return future;
+    }
+
+    size_t GetNumThreads() const { return workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    ThreadPool()
+    {
+        unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < numThreads; ++i)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "render_state.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binding points of the uniform blocks declared in shaders/uniform_blocks.glsl.
+// Shader binds the blocks of every program that includes them at link time (no layout(binding) on GL 4.1).
+constexpr GLuint FRAME_UNIFORMS_BINDING = 0;
+constexpr GLuint LIGHTING_UNIFORMS_BINDING = 1;
+
+const std::vector<std::pair<const char*, GLuint>> UNIFORM_BLOCK_BINDINGS = {
+    { "FrameUniforms", FRAME_UNIFORMS_BINDING },
+    { "LightingUniforms", LIGHTING_UNIFORMS_BINDING }
+};
+
+// The structs below mirror the std140 blocks: a vec3 takes 16 bytes unless a scalar fills its last 4,
+// so every vec3 is followed by a scalar or explicit padding
+
+// Changes every frame: camera and torch
+struct FrameUniforms
+{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::vec3 cameraPos;
+    float time;
+    glm::vec3 torchPos;
+    int32_t torchActivated;
+    glm::vec3 torchDir;
+    int32_t menuActive;
+};
+static_assert(offsetof(FrameUniforms, cameraPos) == 128 && offsetof(FrameUniforms, torchDir) == 160 &&
+              sizeof(FrameUniforms) == 176, "FrameUniforms does not match the std140 layout");
+
+// Set once from the settings
+struct LightingUniforms
+{
+    glm::vec3 torchColor;
+    float torchInnerCutoff; // Cosines of the cone angles
+    glm::vec3 ambientColor;
+    float torchOuterCutoff;
+    float torchAttenuationConstant;
+    float torchAttenuationLinear;
+    float torchAttenuationQuadratic;
+    float ambientIntensity;
+    float specularShininess;
+    float specularIntensity;
+    float attenuationConstant;
+    float attenuationLinear;
+    float attenuationQuadratic;
+    float padding[3];
+};
+static_assert(offsetof(LightingUniforms, torchAttenuationConstant) == 32 && sizeof(LightingUniforms) == 80,
+              "LightingUniforms does not match the std140 layout");
+
+// Uniform buffer holding one block, bound to its binding point when created.
+// Move-only, the buffer is deleted with the object. Uploads are skipped while the data stays the same.
+template <typename T>
+class UniformBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "uniform blocks are uploaded as raw bytes");
+
+public:
+    explicit UniformBuffer(GLuint binding)
+        : binding(binding)
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        Bind();
+    }
+
+    ~UniformBuffer()
+    {
+        RenderState::GetInstance().DeleteUniformBuffer(UBO);
+    }
+
+    UniformBuffer(UniformBuffer&& other) noexcept
+        : UBO(std::exchange(other.UBO, 0)), binding(other.binding), uploaded(other.uploaded), data(other.data)
+    {}
+
+    UniformBuffer& operator=(UniformBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            RenderState::GetInstance().DeleteUniformBuffer(UBO);
+            UBO = std::exchange(other.UBO, 0);
+            binding = other.binding;
+            uploaded = other.uploaded;
+            data = other.data;
+        }
+        return *this;
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void Upload(const T& value)
+    {
+        if (uploaded && std::memcmp(&data, &value, sizeof(T)) == 0)
+            return;
+
+        data = value;
+        uploaded = true;
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Points the binding back at this buffer, after another one took it over
+    void Bind() const
+    {
+        RenderState::GetInstance().BindUniformBuffer(binding, UBO);
+    }
+
+    GLuint GetID() const { return UBO; }
+    GLuint GetBinding() const { return binding; }
+
+private:
+    GLuint UBO = 0;
+    GLuint binding;
+    bool uploaded = false;
+    T data{};
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Name of a shader uniform, reduced to its 64-bit FNV-1a hash. Literals convert implicitly and are hashed at
+// compile time, so setting a uniform neither builds nor hashes a string; Shader resolves the hash against
+// the uniforms it reflected at link time.
+class UniformName
+{
+public:
+    consteval UniformName(const char* name)
+        : hash(Hash(name))
+    {}
+
+    // For names only known at run time (numbered samplers): hash them once, when the owner is built
+    static constexpr UniformName FromString(std::string_view name)
+    {
+        return UniformName(Hash(name), 0);
+    }
+
+    static constexpr uint64_t Hash(std::string_view name)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    constexpr uint64_t GetHash() const { return hash; }
+
+private:
+    uint64_t hash;
+
+    constexpr UniformName(uint64_t hash, int)
+        : hash(hash)
+    {}
+};
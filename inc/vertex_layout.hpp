@@ -0,0 +1,154 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// Full precision vertex produced by the importers and kept on the CPU (baked files, retained mesh data).
+// It is packed into one of the compact GPU formats below when a mesh is uploaded.
+struct Vertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::ivec4 BoneIDs;
+    glm::vec4 BoneWeights;
+};
+
+enum class VertexFormat
+{
+    Static,  // Position, normal, texture coordinates
+    Skinned  // Same plus four joint influences
+};
+
+// 20 bytes: float position, snorm 10:10:10:2 normal, half float texture coordinates
+struct PackedStaticVertex
+{
+    glm::vec3 Position;
+    uint32_t Normal;
+    uint32_t TexCoords;
+};
+
+// 28 bytes: the static vertex plus u8 joint indices and unorm8 weights (palettes hold at most 256 joints)
+struct PackedSkinnedVertex
+{
+    glm::vec3 Position;
+    uint32_t Normal;
+    uint32_t TexCoords;
+    uint8_t BoneIDs[4];
+    uint8_t BoneWeights[4];
+};
+
+// One vertex attribute as glVertexAttrib(I)Pointer sees it
+struct VertexAttribute
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    bool integer; // Read as an integer in the shader (glVertexAttribIPointer)
+    size_t offset;
+};
+
+struct VertexLayout
+{
+    GLsizei stride;
+    std::vector<VertexAttribute> attributes;
+
+    // Enables and describes every attribute of the layout on the bound vertex array and array buffer
+    void Apply() const
+    {
+        for (const auto& attribute : attributes)
+        {
+            glEnableVertexAttribArray(attribute.location);
+            if (attribute.integer)
+                glVertexAttribIPointer(attribute.location, attribute.size, attribute.type, stride, (void*)attribute.offset);
+            else
+                glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, stride,
+                                      (void*)attribute.offset);
+        }
+    }
+};
+
+// Attribute locations match default.vs: 0 position, 1 normal, 2 texture coordinates, 3 joints, 4 weights
+inline const VertexLayout& GetVertexLayout(VertexFormat format)
+{
+    static const VertexLayout staticLayout = {
+        sizeof(PackedStaticVertex),
+        {
+            { 0, 3, GL_FLOAT, GL_FALSE, false, offsetof(PackedStaticVertex, Position) },
+            { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false, offsetof(PackedStaticVertex, Normal) },
+            { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(PackedStaticVertex, TexCoords) }
+        }
+    };
+    static const VertexLayout skinnedLayout = {
+        sizeof(PackedSkinnedVertex),
+        {
+            { 0, 3, GL_FLOAT, GL_FALSE, false, offsetof(PackedSkinnedVertex, Position) },
+            { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false, offsetof(PackedSkinnedVertex, Normal) },
+            { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(PackedSkinnedVertex, TexCoords) },
+            { 3, 4, GL_UNSIGNED_BYTE, GL_FALSE, true, offsetof(PackedSkinnedVertex, BoneIDs) },
+            { 4, 4, GL_UNSIGNED_BYTE, GL_TRUE, false, offsetof(PackedSkinnedVertex, BoneWeights) }
+        }
+    };
+    return format == VertexFormat::Skinned ? skinnedLayout : staticLayout;
+}
+
+inline uint32_t PackNormal(const glm::vec3& normal)
+{
+    float length = glm::length(normal);
+    return glm::packSnorm3x10_1x2(glm::vec4(length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f), 0.0f));
+}
+
+// Unused influences (joint -1) get weight 0; the rounding error goes to the largest weight so they still sum to 1
+inline void PackInfluences(const Vertex& vertex, uint8_t (&boneIDs)[4], uint8_t (&boneWeights)[4])
+{
+    int total = 0, largest = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        bool used = vertex.BoneIDs[i] >= 0;
+        boneIDs[i] = used ? static_cast<uint8_t>(std::min(vertex.BoneIDs[i], 255)) : 0;
+        boneWeights[i] = used ? static_cast<uint8_t>(glm::round(glm::clamp(vertex.BoneWeights[i], 0.0f, 1.0f) * 255.0f)) : 0;
+        total += boneWeights[i];
+        if (boneWeights[i] > boneWeights[largest])
+            largest = i;
+    }
+    if (total > 0)
+        boneWeights[largest] = static_cast<uint8_t>(std::clamp(boneWeights[largest] + 255 - total, 0, 255));
+}
+
+// Converts import vertices into the GPU format, ready for glBufferData
+inline std::vector<std::byte> PackVertices(std::span<const Vertex> vertices, VertexFormat format)
+{
+    std::vector<std::byte> packed(vertices.size() * GetVertexLayout(format).stride);
+
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const Vertex& vertex = vertices[i];
+        if (format == VertexFormat::Skinned)
+        {
+            PackedSkinnedVertex out;
+            out.Position = vertex.Position;
+            out.Normal = PackNormal(vertex.Normal);
+            out.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+            PackInfluences(vertex, out.BoneIDs, out.BoneWeights);
+            std::memcpy(packed.data() + i * sizeof(out), &out, sizeof(out));
+        }
+        else
+        {
+            PackedStaticVertex out;
+            out.Position = vertex.Position;
+            out.Normal = PackNormal(vertex.Normal);
+            out.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+            std::memcpy(packed.data() + i * sizeof(out), &out, sizeof(out));
+        }
+    }
+    return packed;
+}
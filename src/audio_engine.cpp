@@ -84,7 +84,8 @@ bool AudioEngine::LoopSound(const std::string& path, float volume)
     if (!initialized)
         return false;
 
-    ma_uint32 flags = MA_SOUND_FLAG_LOOPING | MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_NO_PITCH;
+    // Decoded on miniaudio's resource manager threads, playback starts once the data is in
+    ma_uint32 flags = MA_SOUND_FLAG_LOOPING | MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_NO_PITCH | MA_SOUND_FLAG_ASYNC;
     ma_sound* pSound = initSound(path, flags);
 
     if (pSound)
@@ -103,7 +104,7 @@ ma_sound* AudioEngine::AddEmitter(const std::string& path, const glm::vec3& posi
     if (!initialized)
         return nullptr;
 
-    ma_uint32 flags = MA_SOUND_FLAG_LOOPING;
+    ma_uint32 flags = MA_SOUND_FLAG_LOOPING | MA_SOUND_FLAG_ASYNC;
 
     ma_sound* pSound = new ma_sound;
     ma_result result = ma_sound_init_from_file(&engine, path.c_str(), flags, nullptr, nullptr, pSound);
@@ -0,0 +1,80 @@
+#include "baked_model_file.hpp"
+#include "model.hpp"
+#include "model_data.hpp"
+#include "model_loader.hpp"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <exception>
+#include <iostream>
+#include <string>
+
+// Converts a source model (.glb, .fbx...) into the baked format loaded at runtime:
+// vertex and index blobs ready for glBufferData, ozz skeleton and optimized animations, texture references.
+
+static void PrintUsage()
+{
+    std::cerr << "Usage: dunkelheit_bake <model> [output] [--tolerance t] [--distance d]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input, output;
+    AnimationCompression compression;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tolerance" && i + 1 < argc)
+            compression.Tolerance = std::stof(argv[++i]);
+        else if (arg == "--distance" && i + 1 < argc)
+            compression.Distance = std::stof(argv[++i]);
+        else if (input.empty())
+            input = arg;
+        else if (output.empty())
+            output = arg;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (input.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+    if (output.empty())
+        output = BakedModelFile::PathFor(input);
+
+    // Animated models go through the skeletal importer, everything else through the static one
+    bool animated = false;
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(input, 0);
+        if (!scene)
+        {
+            std::cerr << "ERROR::ASSIMP: " << importer.GetErrorString() << std::endl;
+            return 1;
+        }
+        animated = scene->HasAnimations();
+    }
+
+    ModelData data;
+    try
+    {
+        bool imported = animated ? ModelLoader::GetInstance().Import(input, data, compression)
+                                 : Model::Import(input, data);
+        if (!imported)
+            return 1;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return BakedModelFile::Write(output, data) ? 0 : 1;
+}
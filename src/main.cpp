@@ -1,23 +1,34 @@
+#include "asset_pipeline.hpp"
 #include "audio_engine.hpp"
 #include "fps_camera.hpp"
 #include "game_scene.hpp"
+#include "level.hpp"
+#include "light_clusters.hpp"
 #include "main_menu.hpp"
+#include "material.hpp"
 #include "pixelator.hpp"
 #include "player_audio_system.hpp"
 #include "random_generator.hpp"
+#include "render_state.hpp"
+#include "render_stats.hpp"
 #include "settings.hpp"
 #include "shader.hpp"
 #include "text_renderer.hpp"
+#include "texture_cache.hpp"
 #include "torch.hpp"
+#include "uniform_buffer.hpp"
 #include "working_directory.hpp"
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <array>
 #include <filesystem>
 #include <iostream>
 #include <string>
+#include <vector>
 
 void ProcessInput(GLFWwindow* window, float deltaTime);
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
@@ -25,9 +36,10 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void CursorPosCallback(GLFWwindow* window, double xposIn, double yposIn);
 void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
-void SetupShaders(const Shader& shader);
+void SetupShaders(const Shader& shader, UniformBuffer<LightingUniforms>& lightingBuffer);
 void CalculateFPS(float& lastTime, float& lastFPSTime, float& deltaTime, int& frames, int& fps);
-void Render(const Shader& shader);
+void Render(const Shader& shader, const Shader& alphaTestShader, UniformBuffer<FrameUniforms>& frameBuffer,
+            LightClusters& lightClusters);
 void RenderDebugInfo(TextRenderer& textRenderer, Shader& textShader, const int fps);
 void SetupMenu(GLFWwindow* window);
 void Restart();
@@ -41,12 +53,16 @@ Torch TorchLight;
 PlayerAudioSystem* PlayerAudio;
 GameScene* Scene;
 MainMenu* Menu;
+Shader* SkinningShader = nullptr;
+Shader* DepthShader = nullptr;
 
 float CurrentTime = 0.0f;
 bool FirstMouse = true;
 float LastX, LastY;
 
 bool GameStarted = false;
+bool SceneLoaded = false;
+bool SceneLoadFailed = false;
 
 int main()
 {
@@ -130,118 +146,177 @@ int main()
     RandomGenerator& random = RandomGenerator::GetInstance();
     random.SetSeed(1337);
 
-    // load TexRenderer
-    TextRenderer textRenderer(Settings.FontFile, Settings.FontSize);
-    Shader textShader(Settings.TextVertexShaderFile, Settings.TextFragmentShaderFile);
-    glm::mat4 orthoProjection = glm::ortho(0.0f, static_cast<float>(Settings.WindowWidth), 0.0f, static_cast<float>(Settings.WindowHeight));
-    textShader.Use();
-    textShader.SetMat4("projectionMatrix", orthoProjection);
-
-    // main menu
-    Menu = new MainMenu(Settings.MenuItemClickSoundFile);
-    SetupMenu(window);
-
-    // load GameScene
-    Scene = new GameScene(Settings);
-    // load items
-    Scene->AddItem(Settings.LeftWeaponModelFile, Settings.LeftWeaponTextureFile,
-        Settings.LeftWeaponPositionOffset, Settings.LeftWeaponRotationOffset, Settings.LeftWeaponScale);
-    Scene->AddItem(Settings.RightWeaponModelFile, Settings.RightWeaponTextureFile,
-        Settings.RightWeaponPositionOffset, Settings.RightWeaponRotationOffset, Settings.RightWeaponScale);
-
-    // load camera
-    Camera.Constrained = true;
-    Camera.FOV = Settings.FOV;
-    Camera.AspectRatio = static_cast<GLfloat>(Settings.WindowWidth) / static_cast<GLfloat>(Settings.WindowHeight);
-    Camera.Position = Scene->GetStartingPosition();
-    Camera.MovementSpeed = Settings.PlayerSpeed;
-    Camera.HeadHeight = Settings.PlayerHeadHeight;
-
-    // load post processing
-    Pixelator pixelator(
-        (GLuint)(Settings.FrameBufferWidth / Settings.PixelScale),
-        (GLuint)(Settings.FrameBufferHeight / Settings.PixelScale),
-        Settings.FrameBufferWidth,
-        Settings.FrameBufferHeight
-    );
-
-    // initialize player state and audio system
-    Player.Init(Camera);
-    PlayerAudio = new PlayerAudioSystem(Settings.FootstepsSoundFiles, Settings.TorchToggleSoundFile);
-
-    TorchLight.PositionOffset = Settings.TorchPos;
-
-    Shader defaultShader(Settings.ForwardShadingVertexShaderFile, Settings.ForwardShadingFragmentShaderFile);
-    SetupShaders(defaultShader);
-    Scene->SetLights(defaultShader);
-
-    // setup OpenGL
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-
-    // play ambient music
-    AudioEngine::GetInstance().LoopSound(Settings.AmbientMusicFile, 0.5f);
-    AudioEngine::GetInstance().AddEmitter(Settings.GizmoSoundFile, glm::vec3(23.0f, 1.5f, 139.0f));
-
-    // game loop
-    // -----------
-    float lastTime    = 0.0f;
-    float lastFPSTime = 0.0f;
-    float deltaTime   = 0.0f;
-    int frames = 0;
-    int fps    = 0;
-
-    while (!glfwWindowShouldClose(window))
+    // the locals below delete their GL objects when destroyed, so this scope closes before glfwTerminate()
     {
-        // calculate deltaTime and FPS
-        // ---------------------------
-        CalculateFPS(lastTime, lastFPSTime, deltaTime, frames, fps);
-
-        // update
-        // ------
-        // Only process movement and game world if menu is closed
-        if (!Menu->Active)
+        // load TexRenderer
+        TextRenderer textRenderer(Settings.FontFile, Settings.FontSize);
+        Shader textShader(Settings.TextVertexShaderFile, Settings.TextFragmentShaderFile);
+        glm::mat4 orthoProjection = glm::ortho(0.0f, static_cast<float>(Settings.WindowWidth), 0.0f, static_cast<float>(Settings.WindowHeight));
+        textShader.Use();
+        textShader.SetMat4("projectionMatrix", orthoProjection);
+
+        // main menu
+        Menu = new MainMenu(Settings.MenuItemClickSoundFile);
+        SetupMenu(window);
+
+        // load GameScene: streams in while the menu is already running
+        Scene = new GameScene(Settings);
+        Scene->Load();
+        // load items
+        Scene->LoadItem(Settings.LeftWeaponModelFile, Settings.LeftWeaponTextureFile,
+            Settings.LeftWeaponPositionOffset, Settings.LeftWeaponRotationOffset, Settings.LeftWeaponScale);
+        Scene->LoadItem(Settings.RightWeaponModelFile, Settings.RightWeaponTextureFile,
+            Settings.RightWeaponPositionOffset, Settings.RightWeaponRotationOffset, Settings.RightWeaponScale);
+
+        // load camera
+        Camera.Constrained = true;
+        Camera.FOV = Settings.FOV;
+        Camera.AspectRatio = static_cast<GLfloat>(Settings.WindowWidth) / static_cast<GLfloat>(Settings.WindowHeight);
+        Camera.FarPlane = Settings.DrawDistance;
+        Camera.MovementSpeed = Settings.PlayerSpeed;
+        Camera.HeadHeight = Settings.PlayerHeadHeight;
+
+        // load post processing
+        Pixelator pixelator(
+            (GLuint)(Settings.FrameBufferWidth / Settings.PixelScale),
+            (GLuint)(Settings.FrameBufferHeight / Settings.PixelScale),
+            Settings.FrameBufferWidth,
+            Settings.FrameBufferHeight
+        );
+
+        // initialize audio system, the player state follows once the scene is loaded
+        PlayerAudio = new PlayerAudioSystem(Settings.FootstepsSoundFiles, Settings.TorchToggleSoundFile);
+
+        TorchLight.PositionOffset = Settings.TorchPos;
+
+        std::vector<std::string> shaderDefines = ForwardShadingDefines(Settings);
+        Shader defaultShader(Settings.ForwardShadingVertexShaderFile, Settings.ForwardShadingFragmentShaderFile, "", shaderDefines);
+        // transparent pass: the same program with the alpha test, so the opaque one never discards
+        std::vector<std::string> alphaTestDefines = shaderDefines;
+        alphaTestDefines.push_back("ALPHA_TEST");
+        Shader alphaTestShader(Settings.ForwardShadingVertexShaderFile, Settings.ForwardShadingFragmentShaderFile, "", alphaTestDefines);
+
+        // shared uniform blocks: every program including shaders/uniform_blocks.glsl reads them
+        UniformBuffer<FrameUniforms> frameBuffer(FRAME_UNIFORMS_BINDING);
+        UniformBuffer<LightingUniforms> lightingBuffer(LIGHTING_UNIFORMS_BINDING);
+        SetupShaders(defaultShader, lightingBuffer);
+        SetupShaders(alphaTestShader, lightingBuffer);
+
+        // depth pre-pass: the same vertex shader without the varyings, so the opaque draws are shaded once per pixel
+        if (Settings.DepthPrepass)
         {
-            ProcessInput(window, deltaTime);
-
-            Scene->Update(deltaTime, Camera);
-            Player.Position = Camera.Position;
-            Player.Front = Camera.Front;
-            PlayerAudio->Update(Player, CurrentTime);
-            TorchLight.Update(Camera);
+            std::vector<std::string> depthDefines = shaderDefines;
+            depthDefines.push_back("DEPTH_PASS");
+            DepthShader = new Shader(Settings.ForwardShadingVertexShaderFile, Settings.DepthPrepassFragmentShaderFile, "", depthDefines);
+            DepthShader->Use();
+            DepthShader->SetInt("bakedPoses", BAKED_POSES_TEXTURE_UNIT);
         }
 
-        // render
-        // ------
-        if (Settings.Pixelate)
-            pixelator.BeginRender();
-
-        Render(defaultShader);
-
-        if (Settings.Pixelate)
-            pixelator.EndRender();
+        // level lights, binned every frame into the clusters of the view frustum
+        LightClusters lightClusters(Settings.DrawDistance, Settings.AttenuationConstant, Settings.AttenuationLinear,
+                                    Settings.AttenuationQuadratic, Settings.AttenuationCutoff);
 
-        if (Settings.ShowDebugInfo)
-            RenderDebugInfo(textRenderer, textShader, fps);
-
-        // Render Menu last (so it's on top of everything)
-        if (Menu->Active)
-            Menu->Render(textRenderer, textShader, Settings.WindowWidth, Settings.WindowHeight);
+        // skinning stage: enemies are skinned once per pose into transform feedback buffers
+        if (Settings.TransformFeedbackSkinning)
+        {
+            std::vector<std::string> skinningDefines = shaderDefines;
+            skinningDefines.push_back("SKINNING_PASS");
+            SkinningShader = new Shader(Settings.ForwardShadingVertexShaderFile, SKINNING_FEEDBACK_VARYINGS, skinningDefines);
+            SkinningShader->Use();
+            SkinningShader->SetInt("bakedPoses", BAKED_POSES_TEXTURE_UNIT);
+        }
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // setup OpenGL; the context starts with the viewport covering the framebuffer
+        RenderState& renderState = RenderState::GetInstance();
+        renderState.Viewport(0, 0, Settings.FrameBufferWidth, Settings.FrameBufferHeight);
+        renderState.Enable(GL_DEPTH_TEST);
+        renderState.Enable(GL_CULL_FACE);
+
+        // play ambient music
+        AudioEngine::GetInstance().LoopSound(Settings.AmbientMusicFile, 0.5f);
+        AudioEngine::GetInstance().AddEmitter(Settings.GizmoSoundFile, glm::vec3(23.0f, 1.5f, 139.0f));
+
+        // game loop
+        // -----------
+        float lastTime    = 0.0f;
+        float lastFPSTime = 0.0f;
+        float deltaTime   = 0.0f;
+        int frames = 0;
+        int fps    = 0;
+
+        while (!glfwWindowShouldClose(window))
+        {
+            // calculate deltaTime and FPS
+            // ---------------------------
+            CalculateFPS(lastTime, lastFPSTime, deltaTime, frames, fps);
+            RenderStats::GetInstance().Reset();
+
+            // streaming: GL uploads of the assets loaded in the background
+            // ---------------------------------------------------------------
+            AssetPipeline::GetInstance().ProcessUploads(Settings.AssetUploadBudget);
+            if (!SceneLoaded && Scene->IsLoaded())
+            {
+                SceneLoaded = true;
+                Scene->SetLights(lightClusters);
+                Camera.Position = Scene->GetStartingPosition();
+                Player.Init(Camera);
+                SetupMenu(window); // Loading... -> Start
+            }
+            else if (!SceneLoaded && !SceneLoadFailed && Scene->HasLoadFailed())
+            {
+                SceneLoadFailed = true;
+                SetupMenu(window); // Loading... -> Loading failed
+            }
+
+            // update
+            // ------
+            // Only process movement and game world if menu is closed
+            if (!Menu->Active)
+            {
+                ProcessInput(window, deltaTime);
+
+                Scene->Update(deltaTime, Camera);
+                Player.Position = Camera.Position;
+                Player.Front = Camera.Front;
+                PlayerAudio->Update(Player, CurrentTime);
+                TorchLight.Update(Camera);
+            }
+
+            // render
+            // ------
+            if (Settings.Pixelate)
+                pixelator.BeginRender();
+
+            Render(defaultShader, alphaTestShader, frameBuffer, lightClusters);
+
+            if (Settings.Pixelate)
+                pixelator.EndRender();
+
+            if (Settings.ShowDebugInfo)
+                RenderDebugInfo(textRenderer, textShader, fps);
+
+            // Render Menu last (so it's on top of everything)
+            if (Menu->Active)
+                Menu->Render(textRenderer, textShader, Settings.WindowWidth, Settings.WindowHeight);
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            if (!GameStarted) Menu->Active = true;
+        }
 
-        if (!GameStarted) Menu->Active = true;
+        // optional: de-allocate all resources once they've outlived their purpose:
+        // ------------------------------------------------------------------------
+        AssetPipeline::GetInstance().Finish(); // loading tasks still write into the scene
+        delete Scene;
+        delete PlayerAudio;
+        delete Menu;
+        delete SkinningShader;
+        delete DepthShader;
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
-    // ------------------------------------------------------------------------
-    delete Scene;
-    delete PlayerAudio;
-    delete Menu;
-
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -268,7 +343,7 @@ void FramebufferSizeCallback(GLFWwindow* /* window */, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    RenderState::GetInstance().Viewport(0, 0, width, height);
 }
 
 // glfw: whenever a keyboard key is pressed, this callback is called
@@ -352,25 +427,31 @@ void MouseButtonCallback(GLFWwindow* window, int button, int action, int /* mods
         Shoot();
 }
 
-void SetupShaders(const Shader& shader)
+void SetupShaders(const Shader& shader, UniformBuffer<LightingUniforms>& lightingBuffer)
 {
     shader.Use();
-    shader.SetMat4("projectionMatrix", Camera.GetProjectionMatrix());
     shader.SetInt("texture_diffuse0", 0);
     shader.SetInt("texture_specular0", 1);
-    shader.SetVec3("torchColor", Settings.TorchColor);
-    shader.SetFloat("torchInnerCutoff", glm::cos(glm::radians(Settings.TorchInnerCutoff)));
-    shader.SetFloat("torchOuterCutoff", glm::cos(glm::radians(Settings.TorchOuterCutoff)));
-    shader.SetFloat("torchAttenuationConstant", Settings.TorchAttenuationConstant);
-    shader.SetFloat("torchAttenuationLinear", Settings.TorchAttenuationLinear);
-    shader.SetFloat("torchAttenuationQuadratic", Settings.TorchAttenuationQuadratic);
-    shader.SetVec3("ambientColor", Settings.AmbientColor);
-    shader.SetFloat("ambientIntensity", Settings.AmbientIntensity);
-    shader.SetFloat("specularShininess", Settings.SpecularShininess);
-    shader.SetFloat("specularIntensity", Settings.SpecularIntensity);
-    shader.SetFloat("attenuationConstant", Settings.AttenuationConstant);
-    shader.SetFloat("attenuationLinear", Settings.AttenuationLinear);
-    shader.SetFloat("attenuationQuadratic", Settings.AttenuationQuadratic);
+    shader.SetInt("bakedPoses", BAKED_POSES_TEXTURE_UNIT);
+    shader.SetInt("lightmap", LIGHTMAP_TEXTURE_UNIT);
+    MaterialLibrary::SetupSamplers(shader);
+    LightClusters::SetupSamplers(shader);
+
+    LightingUniforms lighting{};
+    lighting.torchColor = Settings.TorchColor;
+    lighting.torchInnerCutoff = glm::cos(glm::radians(Settings.TorchInnerCutoff));
+    lighting.torchOuterCutoff = glm::cos(glm::radians(Settings.TorchOuterCutoff));
+    lighting.torchAttenuationConstant = Settings.TorchAttenuationConstant;
+    lighting.torchAttenuationLinear = Settings.TorchAttenuationLinear;
+    lighting.torchAttenuationQuadratic = Settings.TorchAttenuationQuadratic;
+    lighting.ambientColor = Settings.AmbientColor;
+    lighting.ambientIntensity = Settings.AmbientIntensity;
+    lighting.specularShininess = Settings.SpecularShininess;
+    lighting.specularIntensity = Settings.SpecularIntensity;
+    lighting.attenuationConstant = Settings.AttenuationConstant;
+    lighting.attenuationLinear = Settings.AttenuationLinear;
+    lighting.attenuationQuadratic = Settings.AttenuationQuadratic;
+    lightingBuffer.Upload(lighting);
 }
 
 void CalculateFPS(float& lastTime, float& lastFPSTime, float& deltaTime, int& frames, int& fps)
@@ -387,35 +468,43 @@ void CalculateFPS(float& lastTime, float& lastFPSTime, float& deltaTime, int& fr
     lastTime = CurrentTime;
 }
 
-void Render(const Shader& shader)
+void Render(const Shader& shader, const Shader& alphaTestShader, UniformBuffer<FrameUniforms>& frameBuffer,
+            LightClusters& lightClusters)
 {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    shader.Use();
-    shader.SetMat4("viewMatrix", Camera.GetViewMatrix());
-    shader.SetVec3("cameraPos", Camera.Position);
-    shader.SetVec3("torchPos", TorchLight.Position);
-    shader.SetVec3("torchDir", TorchLight.Direction);
-    shader.SetFloat("time", CurrentTime);
-    shader.SetBool("torchActivated", Player.IsTorchOn);
-    shader.SetBool("menuActive", Menu->Active);
-
-    Scene->Draw(shader);
+    FrameUniforms frame{};
+    frame.viewMatrix = Camera.GetViewMatrix();
+    frame.projectionMatrix = Camera.GetProjectionMatrix();
+    frame.cameraPos = Camera.Position;
+    frame.time = CurrentTime;
+    frame.torchPos = TorchLight.Position;
+    frame.torchActivated = Player.IsTorchOn;
+    frame.torchDir = TorchLight.Direction;
+    frame.menuActive = Menu->Active;
+    frameBuffer.Upload(frame);
+
+    lightClusters.Update(frame.viewMatrix, frame.projectionMatrix);
+    lightClusters.Bind();
+
+    if (SkinningShader)
+        Scene->Skin(*SkinningShader);
+
+    Scene->Draw(shader, Camera.Position, DepthShader, &alphaTestShader);
 }
 
 void RenderDebugInfo(TextRenderer& textRenderer, Shader& textShader, const int fps)
 {
-    // save current blending state
-    GLboolean blendEnabled = glIsEnabled(GL_BLEND);
-    GLint srcAlphaFunc, dstAlphaFunc;
-    glGetIntegerv(GL_BLEND_SRC_ALPHA, &srcAlphaFunc);
-    glGetIntegerv(GL_BLEND_DST_ALPHA, &dstAlphaFunc);
+    // save current blending state, from the shadow copy rather than glGet
+    RenderState& renderState = RenderState::GetInstance();
+    bool blendEnabled = renderState.IsEnabled(GL_BLEND);
+    std::array<GLenum, 2> blendFunc = renderState.GetBlendFunc();
 
     // enable alpha blending and set blend function
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    renderState.Disable(GL_DEPTH_TEST);
+    renderState.Enable(GL_BLEND);
+    renderState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     textRenderer.BeginBatch();
 
@@ -427,21 +516,65 @@ void RenderDebugInfo(TextRenderer& textRenderer, Shader& textShader, const int f
     textRenderer.AddText(fbStr, 4.0f, Settings.WindowHeight - 60.0f, 1.0f);
     std::string posStr = "pos x: " + std::to_string((int)Camera.Position.x) + ", z: " + std::to_string((int)Camera.Position.z);
     textRenderer.AddText(posStr, 4.0f, Settings.WindowHeight - 80.0f, 1.0f);
+    std::string jointsStr = "joints: " + std::to_string(RenderStats::GetInstance().EvaluatedJoints);
+    textRenderer.AddText(jointsStr, 4.0f, Settings.WindowHeight - 100.0f, 1.0f);
+    std::string loadingStr = "loading: " + std::to_string(AssetPipeline::GetInstance().GetPendingTasks());
+    textRenderer.AddText(loadingStr, 4.0f, Settings.WindowHeight - 120.0f, 1.0f);
+    TextureCache& textureCache = TextureCache::GetInstance();
+    std::string texturesStr = "textures: " + std::to_string(textureCache.GetResidentTextures()) +
+                              " (" + std::to_string(textureCache.GetResidentBytes() / 1024) + " KB), hits: " +
+                              std::to_string(textureCache.GetHits()) + ", misses: " + std::to_string(textureCache.GetMisses());
+    textRenderer.AddText(texturesStr, 4.0f, Settings.WindowHeight - 140.0f, 1.0f);
+    RenderStats& renderStats = RenderStats::GetInstance();
+    std::string trianglesStr = "triangles: " + std::to_string(renderStats.SubmittedTriangles) +
+                               " (without LOD: " + std::to_string(renderStats.FullDetailTriangles) + ")";
+    textRenderer.AddText(trianglesStr, 4.0f, Settings.WindowHeight - 160.0f, 1.0f);
+    std::string stateStr = "state changes: " + std::to_string(renderStats.StateChanges) +
+                           " (elided: " + std::to_string(renderStats.ElidedStateChanges) + ")";
+    textRenderer.AddText(stateStr, 4.0f, Settings.WindowHeight - 180.0f, 1.0f);
+    std::string drawsStr = "draws: " + std::to_string(renderStats.DrawBatches) +
+                           " (packets: " + std::to_string(renderStats.DrawPackets) + ")";
+    textRenderer.AddText(drawsStr, 4.0f, Settings.WindowHeight - 200.0f, 1.0f);
+    MaterialLibrary& materials = MaterialLibrary::GetInstance();
+    std::string materialsStr = "materials: " + std::to_string(materials.GetMaterialCount()) +
+                               " (pages: " + std::to_string(materials.GetPageCount()) + "), merged: " +
+                               std::to_string(renderStats.MergedMaterialDraws) + ", binds kept: " +
+                               std::to_string(renderStats.KeptMaterialBindings);
+    textRenderer.AddText(materialsStr, 4.0f, Settings.WindowHeight - 220.0f, 1.0f);
+    std::string lightsStr = "lights: " + std::to_string(renderStats.VisibleLights) +
+                            " visible, max per cluster: " + std::to_string(renderStats.MaxClusterLights);
+    textRenderer.AddText(lightsStr, 4.0f, Settings.WindowHeight - 240.0f, 1.0f);
+    // Relative to the pixels of the scene, at its resolution: 100% is every pixel shaded exactly once
+    float scale = Settings.Pixelate ? Settings.PixelScale : 1.0f;
+    unsigned long long pixels = std::max(1ull, static_cast<unsigned long long>(Settings.FrameBufferWidth / scale) *
+                                               static_cast<unsigned long long>(Settings.FrameBufferHeight / scale));
+    std::string fragmentsStr = "shaded fragments: " + std::to_string(renderStats.ShadedFragments) +
+                               " (" + std::to_string(renderStats.ShadedFragments * 100ull / pixels) + "% of the pixels)" +
+                               ", culled draws: " + std::to_string(renderStats.CulledPackets);
+    textRenderer.AddText(fragmentsStr, 4.0f, Settings.WindowHeight - 260.0f, 1.0f);
 
     textRenderer.FlushBatch(textShader, Settings.FontColor);
 
     // restore previous blending state
-    glBlendFunc(srcAlphaFunc, dstAlphaFunc);
+    renderState.BlendFunc(blendFunc[0], blendFunc[1]);
     if (!blendEnabled)
-        glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+        renderState.Disable(GL_BLEND);
+    renderState.Enable(GL_DEPTH_TEST);
 }
 
 void SetupMenu(GLFWwindow* window)
 {
     Menu->Clear();
 
-    if (!GameStarted)
+    if (!SceneLoaded)
+    {
+        // Still streaming the scene in, or stuck without a level
+        Menu->AddItem(SceneLoadFailed ? "LOADING FAILED" : "LOADING...", []() {});
+        Menu->AddItem("QUIT", [=]() {
+            glfwSetWindowShouldClose(window, true);
+        });
+    }
+    else if (!GameStarted)
     {
         // Initial State
         Menu->AddItem("START", [=]() {
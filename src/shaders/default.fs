@@ -1,42 +1,28 @@
 #version 330 core
 
+#include "uniform_blocks.glsl"
+#include "light_clusters.glsl"
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+flat in vec4 MaterialLayers;
+in vec2 LightmapCoords;
 
 layout(location = 0) out vec4 FragColor;
 
-uniform bool menuActive;
-uniform float time;
-uniform vec3 cameraPos;
-uniform vec3 torchPos;
-uniform vec3 torchDir;
-uniform bool torchActivated;
-uniform vec3 torchColor;
-uniform float torchInnerCutoff;
-uniform float torchOuterCutoff;
-uniform float torchAttenuationConstant;
-uniform float torchAttenuationLinear;
-uniform float torchAttenuationQuadratic;
-uniform vec3 ambientColor;
-uniform float ambientIntensity;
-uniform float specularShininess;
-uniform float specularIntensity;
-uniform float attenuationConstant;
-uniform float attenuationLinear;
-uniform float attenuationQuadratic;
+uniform float opacity = 1.0;
 
 uniform sampler2D texture_diffuse0;
 uniform sampler2D texture_specular0;
 
-struct Light {
-    vec3 position;
-    vec3 color;
-};
+// Meshes sample their material from texture array pages (see MaterialLibrary), the level and impostors a 2D texture
+uniform bool materialArrays = false;
+uniform sampler2DArray materialDiffuse;
 
-#define MAX_LIGHTS 32
-uniform Light lights[MAX_LIGHTS];
-uniform int numLights;
+// The level reads its static lights from a lightmap baked at load (see LightBaker), other geometry from the clusters
+uniform bool bakedLighting = false;
+uniform sampler2D lightmap;
 
 // Fog Uniforms
 uniform vec3 fogColor = vec3(0.05, 0.05, 0.08);
@@ -60,15 +46,21 @@ float CalcAtt(float distance, float constant, float linear, float quadratic)
 
 void main()
 {
+    // Nothing past the draw distance reaches here: the far plane clips it and the render queue culls it
     float pixelDist = length(cameraPos - FragPos);
-    if (pixelDist > 80.0)
-        discard;
 
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(cameraPos - FragPos);
-    vec4 texColor = texture(texture_diffuse0, TexCoords);
+    vec4 texColor = materialArrays ? texture(materialDiffuse, vec3(TexCoords, MaterialLayers.x))
+                                   : texture(texture_diffuse0, TexCoords);
     vec3 Albedo = texColor.rgb;
     float alpha = texColor.a;
+#ifdef ALPHA_TEST
+    // Transparent pass only: empty impostor texels must not write depth. The opaque program has no discard,
+    // so early depth testing stays on for it.
+    if (alpha * opacity < 0.01)
+        discard;
+#endif
 
     // --- 1. LIGHTING CALCULATION ---
     vec3 torchLight = vec3(0.0);
@@ -92,14 +84,25 @@ void main()
 
     float flicker = 0.8 + 0.2 * sin(time * 10.0) * sin(time * 3.0);
     vec3 staticLights = vec3(0.0);
-    for (int i = 0; i < numLights; i++)
+    if (bakedLighting)
+    {
+        staticLights = texture(lightmap, LightmapCoords).rgb * flicker * Albedo;
+    }
+    else
     {
-        float lightDist = length(lights[i].position - FragPos);
-        if (lightDist > 50.0) continue;
-        vec3 lightDir = normalize(lights[i].position - FragPos);
-        staticLights += CalcBlinnPhong(viewDir, norm, lightDir, lights[i].color, 1.0) *
-                        CalcAtt(lightDist, attenuationConstant, attenuationLinear, attenuationQuadratic) *
-                        flicker * Albedo;
+        // Only the lights binned into this fragment's cluster
+        uvec2 lightList = ClusterLightRange(FragPos);
+        for (uint i = 0u; i < lightList.y; i++)
+        {
+            int light = ClusterLight(lightList.x + i);
+            vec4 positionRange = LightPositionRange(light);
+            float lightDist = length(positionRange.xyz - FragPos);
+            if (lightDist > positionRange.w) continue;
+            vec3 lightDir = normalize(positionRange.xyz - FragPos);
+            staticLights += CalcBlinnPhong(viewDir, norm, lightDir, LightColor(light), 1.0) *
+                            CalcAtt(lightDist, attenuationConstant, attenuationLinear, attenuationQuadratic) *
+                            RangeWindow(lightDist, positionRange.w) * flicker * Albedo;
+        }
     }
 
     vec3 combinedLight = torchLight + staticLights;
@@ -157,5 +160,5 @@ void main()
         finalWithFog *= scanline;
     }
 
-    FragColor = vec4(finalWithFog, alpha);
+    FragColor = vec4(finalWithFog, alpha * opacity);
 }
\ No newline at end of file
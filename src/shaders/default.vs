@@ -1,24 +1,89 @@
 #version 330 core
 
+#include "uniform_blocks.glsl"
+
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in ivec4 aBoneIds;
-layout(location = 4) in vec4 aWeights;
+layout(location = 3) in uvec4 aBoneIds;  // u8 joint indices
+layout(location = 4) in vec4 aWeights;   // unorm8, unused influences have weight 0
+// Instanced draws (see RenderQueue): model matrix per instance, locations 5 to 8, then the material layers
+layout(location = 5) in mat4 aInstanceMatrix;
+layout(location = 9) in vec4 aInstanceLayers;
+layout(location = 10) in vec2 aLightmapCoords; // Level only (see Level)
 
+#ifdef SKINNING_PASS
+// Transform feedback output: the skinned vertex in model space
+out vec3 SkinnedPosition;
+out vec3 SkinnedNormal;
+out vec2 SkinnedTexCoords;
+#elif defined(DEPTH_PASS)
+// Depth pre-pass: the position only. Invariant so that the shading pass, built from this same shader,
+// produces the exact same depth and passes its equal test.
+invariant gl_Position;
+#else
+invariant gl_Position;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out vec4 MaterialLayers;
+out vec2 LightmapCoords;
+#endif
 
 uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
 uniform mat3 normalMatrix;
+// Instances only have uniform scale, so their normal matrix is the upper 3x3 of the model matrix
+uniform bool instanced = false;
+// Scale (xy) and offset (zw) applied to the texture coordinates, e.g. to pick an atlas cell
+uniform vec4 texCoordsTransform = vec4(1.0, 1.0, 0.0, 0.0);
+// Texture array layer of each material slot (see MaterialLibrary), per instance when instanced
+uniform vec4 materialLayers = vec4(0.0);
 
 uniform bool animated = false;
 const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
+#ifdef BONE_PALETTE_3X4
+// Compact palette: the three rows of each affine joint matrix, the fourth row is always (0, 0, 0, 1)
+uniform vec4 finalBonesRows[MAX_BONES * 3];
+#else
 uniform mat4 finalBonesMatrices[MAX_BONES];
+#endif
+
+// Baked playback: poses are read from a joint-matrix texture instead of the uniform palette
+uniform bool bakedAnimation = false;
+uniform sampler2D bakedPoses;
+uniform int bakedFrame0;
+uniform int bakedFrame1;
+uniform float bakedFrameBlend;
+
+vec4 FetchBakedRow(int bone, int row)
+{
+    return texelFetch(bakedPoses, ivec2(bone * 3 + row, bakedFrame0), 0) * (1.0 - bakedFrameBlend) +
+           texelFetch(bakedPoses, ivec2(bone * 3 + row, bakedFrame1), 0) * bakedFrameBlend;
+}
+
+// Adds the weighted rows of a joint's 3x4 matrix to the blended skinning transform
+void AccumulateBone(int bone, float weight, inout vec4 row0, inout vec4 row1, inout vec4 row2)
+{
+    if (bakedAnimation)
+    {
+        row0 += FetchBakedRow(bone, 0) * weight;
+        row1 += FetchBakedRow(bone, 1) * weight;
+        row2 += FetchBakedRow(bone, 2) * weight;
+        return;
+    }
+
+#ifdef BONE_PALETTE_3X4
+    row0 += finalBonesRows[bone * 3 + 0] * weight;
+    row1 += finalBonesRows[bone * 3 + 1] * weight;
+    row2 += finalBonesRows[bone * 3 + 2] * weight;
+#else
+    mat4 rows = transpose(finalBonesMatrices[bone]);
+    row0 += rows[0] * weight;
+    row1 += rows[1] * weight;
+    row2 += rows[2] * weight;
+#endif
+}
 
 void main()
 {
@@ -27,34 +92,49 @@ void main()
 
     if (animated)
     {
-        // Calculate the single weighted bone matrix for THIS vertex
-        mat4 boneTransform = mat4(0.0);
+        // Calculate the single weighted bone transform for THIS vertex
+        vec4 row0 = vec4(0.0);
+        vec4 row1 = vec4(0.0);
+        vec4 row2 = vec4(0.0);
         for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
         {
-            if (aBoneIds[i] == -1) continue;
-            if (aBoneIds[i] >= MAX_BONES) break;
+            if (aWeights[i] == 0.0) continue;
+            if (aBoneIds[i] >= uint(MAX_BONES)) break;
 
-            boneTransform += finalBonesMatrices[aBoneIds[i]] * aWeights[i];
+            AccumulateBone(int(aBoneIds[i]), aWeights[i], row0, row1, row2);
         }
 
         // Apply it to position
-        totalPosition = boneTransform * vec4(aPos, 1.0f);
+        vec4 position = vec4(aPos, 1.0f);
+        totalPosition = vec4(dot(row0, position), dot(row1, position), dot(row2, position), 1.0f);
 
-        // Apply it to normal (using mat3 to ignore translation)
-        localNormal = mat3(boneTransform) * aNormal;
-
-        // Final World Space Normal
-        Normal = normalize(normalMatrix * localNormal);
+        // Apply it to normal (using the 3x3 part to ignore translation)
+        localNormal = vec3(dot(row0.xyz, aNormal), dot(row1.xyz, aNormal), dot(row2.xyz, aNormal));
     }
     else
     {
         totalPosition = vec4(aPos, 1.0f);
-        Normal = normalize(normalMatrix * aNormal);
+        localNormal = aNormal;
     }
 
-    vec4 worldPos = modelMatrix * totalPosition;
+#ifdef SKINNING_PASS
+    SkinnedPosition = totalPosition.xyz;
+    SkinnedNormal = localNormal;
+    SkinnedTexCoords = aTexCoords;
+#else
+    mat4 model = instanced ? aInstanceMatrix : modelMatrix;
+    vec4 worldPos = model * totalPosition;
+
+#ifndef DEPTH_PASS
+    // Final World Space Normal
+    Normal = normalize((instanced ? mat3(aInstanceMatrix) : normalMatrix) * localNormal);
+
     FragPos = worldPos.xyz;
-    TexCoords = aTexCoords;
+    TexCoords = aTexCoords * texCoordsTransform.xy + texCoordsTransform.zw;
+    MaterialLayers = instanced ? aInstanceLayers : materialLayers;
+    LightmapCoords = aLightmapCoords;
+#endif
 
     gl_Position = projectionMatrix * viewMatrix * worldPos;
+#endif
 }
\ No newline at end of file
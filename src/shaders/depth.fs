@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth pre-pass (see RenderQueue): default.vs built with DEPTH_PASS writes the depth, no color is written
+void main()
+{
+}
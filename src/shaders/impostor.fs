@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+flat in vec4 MaterialLayers;
+
+layout(location = 0) out vec4 FragColor;
+
+// The captured meshes sample their material from texture array pages (see MaterialLibrary)
+uniform sampler2DArray materialDiffuse;
+
+// Impostor capture: the unlit albedo, lighting is applied when the sprite is drawn
+void main()
+{
+    FragColor = vec4(texture(materialDiffuse, vec3(TexCoords, MaterialLayers.x)).rgb, 1.0);
+}
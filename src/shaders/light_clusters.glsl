@@ -0,0 +1,61 @@
+// Clustered lights, see light_clusters.hpp for the C++ side: the grid constants must match LightClusters.
+// Needs the frame block of uniform_blocks.glsl. CLUSTER_FAR_DEPTH is defined by the program, from drawDistance.
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_NEAR_DEPTH 1.0
+#ifndef CLUSTER_FAR_DEPTH
+#define CLUSTER_FAR_DEPTH 100.0
+#endif
+
+uniform samplerBuffer clusterLights;        // Two texels per light: position and range, then color
+uniform usamplerBuffer clusterGrid;         // Offset and count of the lights of each cluster
+uniform usamplerBuffer clusterLightIndices; // The light lists of all clusters
+
+// Screen tile and exponential depth slice of a world position
+int ClusterIndex(vec3 worldPos)
+{
+    vec4 viewPos = viewMatrix * vec4(worldPos, 1.0);
+    vec4 clip = projectionMatrix * viewPos;
+    vec2 ndc = clip.xy / clip.w;
+    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y)),
+                       ivec2(0), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+
+    float depth = -viewPos.z;
+    int slice = 0;
+    if (depth > CLUSTER_NEAR_DEPTH)
+        slice = min(CLUSTER_SLICES - 1, 1 + int(log(depth / CLUSTER_NEAR_DEPTH) / log(CLUSTER_FAR_DEPTH / CLUSTER_NEAR_DEPTH) *
+                                                float(CLUSTER_SLICES - 1)));
+    return (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+// Offset and count of the cluster's lights in clusterLightIndices
+uvec2 ClusterLightRange(vec3 worldPos)
+{
+    return texelFetch(clusterGrid, ClusterIndex(worldPos)).xy;
+}
+
+int ClusterLight(uint index)
+{
+    return int(texelFetch(clusterLightIndices, int(index)).r);
+}
+
+// xyz: position, w: range
+vec4 LightPositionRange(int light)
+{
+    return texelFetch(clusterLights, light * 2);
+}
+
+vec3 LightColor(int light)
+{
+    return texelFetch(clusterLights, light * 2 + 1).rgb;
+}
+
+// Fades the attenuation out towards the end of the range, so the cutoff leaves no seam
+float RangeWindow(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
@@ -0,0 +1,32 @@
+// Uniform blocks shared by every program that includes this file, see uniform_buffer.hpp for the C++ side
+
+// Changes every frame
+layout(std140) uniform FrameUniforms
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 cameraPos;
+    float time;
+    vec3 torchPos;
+    bool torchActivated;
+    vec3 torchDir;
+    bool menuActive;
+};
+
+// Set once from the settings
+layout(std140) uniform LightingUniforms
+{
+    vec3 torchColor;
+    float torchInnerCutoff;
+    vec3 ambientColor;
+    float torchOuterCutoff;
+    float torchAttenuationConstant;
+    float torchAttenuationLinear;
+    float torchAttenuationQuadratic;
+    float ambientIntensity;
+    float specularShininess;
+    float specularIntensity;
+    float attenuationConstant;
+    float attenuationLinear;
+    float attenuationQuadratic;
+};